@@ -0,0 +1,67 @@
+/**
+ * @file AlignedAllocator.hpp
+ *
+ * Header file describing an allocator that honours the alignment of
+ * over-aligned types, which std::allocator does not guarantee before C++17.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <stdlib.h>
+
+/// Size of a cache line on the platforms we target.
+const size_t CacheLineSize = 64;
+
+/**
+ * @class AlignedAllocator
+ *
+ * Standard-conforming allocator returning storage aligned to at least
+ * alignof(T), for use with containers of cache-line-aligned records.
+ */
+template <typename T> class AlignedAllocator {
+public:
+  typedef T value_type;
+
+  AlignedAllocator() {}
+
+  template <typename U> AlignedAllocator(const AlignedAllocator<U> &) {}
+
+  /**
+   * Allocate aligned storage for a number of objects.
+   *
+   * @param[in] count
+   *    Number of objects of type T to allocate storage for.
+   *
+   * @retval
+   *    Pointer to uninitialized storage.
+   */
+  T *allocate(size_t count) {
+    void *storage = nullptr;
+    size_t alignment =
+        alignof(T) < sizeof(void *) ? sizeof(void *) : alignof(T);
+    if (posix_memalign(&storage, alignment, count * sizeof(T)) != 0) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(storage);
+  }
+
+  /**
+   * Release storage previously returned by allocate.
+   *
+   * @param[in] storage
+   *    Pointer to the storage to release.
+   */
+  void deallocate(T *storage, size_t) { free(storage); }
+};
+
+template <typename T, typename U>
+bool operator==(const AlignedAllocator<T> &, const AlignedAllocator<U> &) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const AlignedAllocator<T> &, const AlignedAllocator<U> &) {
+  return false;
+}
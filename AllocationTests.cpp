@@ -0,0 +1,245 @@
+/**
+ * @file AllocationTests.cpp
+ *
+ * Tests that the BrokerClient order path allocates no memory once warmed up.
+ * The global operator new is replaced with one that counts allocations made
+ * by the test thread, and each client draws its containers from a resource
+ * that counts too, which also catches the aligned allocations that bypass
+ * operator new.
+ */
+
+#include "BrokerClient.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/// Number of allocations made while counting.
+static std::atomic<uint64_t> allocations(0);
+
+/// Set on the test thread while allocations are being counted.
+static thread_local bool counting = false;
+
+void *operator new(size_t size) {
+  if (counting) {
+    allocations++;
+  }
+  void *storage = malloc(size == 0 ? 1 : size);
+  if (storage == nullptr) {
+    throw std::bad_alloc();
+  }
+  return storage;
+}
+
+void operator delete(void *storage) noexcept { free(storage); }
+
+void operator delete(void *storage, size_t) noexcept { free(storage); }
+
+/**
+ * @class CountingResource
+ *
+ * Resource counting the allocations made from it while counting, and
+ * passing them on to the default resource.
+ */
+class CountingResource : public MemoryResource {
+public:
+  void *Allocate(size_t bytes, size_t alignment) override {
+    if (counting) {
+      allocations++;
+    }
+    return DefaultResource()->Allocate(bytes, alignment);
+  }
+
+  void Deallocate(void *storage, size_t bytes, size_t alignment) override {
+    DefaultResource()->Deallocate(storage, bytes, alignment);
+  }
+};
+
+/// Run a callable, returning the number of allocations it made.
+template <typename Body> static uint64_t CountAllocations(Body body) {
+  uint64_t before = allocations.load();
+  counting = true;
+  body();
+  counting = false;
+  return allocations.load() - before;
+}
+
+/// Number of securities traded by each test.
+static const size_t SymbolCount = 100;
+
+/// Number of orders submitted by each test.
+static const size_t OrderCount = 100000;
+
+/**
+ * Intern the securities and reserve space for every order, with room for
+ * the open lots of each security.
+ */
+static std::vector<SymbolId> Warm(BrokerClient &client) {
+  std::vector<SymbolId> ids;
+  for (size_t i = 0; i < SymbolCount; i++) {
+    ids.push_back(client.InternSymbol("SYM" + std::to_string(i)));
+    client.ReserveLots(ids.back(), 4);
+  }
+  bool reserved = client.Reserve(OrderCount);
+  assert(reserved);
+  (void)reserved;
+  return ids;
+}
+
+/**
+ * Get the order at an index in a stream rotating across the securities, in
+ * which every fourth order in each security sells out of it, so that no
+ * security ever holds more than three open lots.
+ */
+static Order OrderAt(const std::vector<SymbolId> &ids, size_t i,
+                     const BrokerClient &client) {
+  size_t round = i / ids.size();
+  Order order = {
+      .kind = round % 4 == 3 ? Sell : Buy,
+      .position = {.name = client.GetSymbolName(ids[i % ids.size()]),
+                   .quantity = (uint32_t)(1 + round % 7),
+                   .price = 10 + (double)(i % 13)}};
+  if (order.kind == Sell) {
+    order.position.quantity = 1000;
+  }
+  return order;
+}
+
+/// Check the counters do see allocations, so that a zero count means much.
+void testCountingWorks() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  uint64_t count = CountAllocations([]() {
+    std::vector<int> *vector = new std::vector<int>(10);
+    delete vector;
+  });
+  assert(count == 2);
+
+  CountingResource resource;
+  BrokerClient client = BrokerClient(1e9, &resource);
+  count = CountAllocations([&]() { client.InternSymbol("AAPL"); });
+  assert(count > 0);
+}
+
+/// Check buys and sells by id allocate nothing once warmed up.
+void testSubmitById() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  CountingResource resource;
+  BrokerClient client = BrokerClient(1e12, &resource);
+  std::vector<SymbolId> ids = Warm(client);
+
+  uint64_t count = CountAllocations([&]() {
+    for (size_t i = 0; i < OrderCount; i++) {
+      Order order = OrderAt(ids, i, client);
+      client.SubmitOrder(order.kind, ids[i % ids.size()],
+                         order.position.quantity, order.position.price);
+    }
+  });
+  assert(count == 0);
+  assert(client.GetTransactionCount() == OrderCount);
+}
+
+/// Check orders submitted by name, singly or in batches, allocate nothing.
+void testSubmitByName() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  CountingResource resource;
+  BrokerClient client = BrokerClient(1e12, &resource);
+  std::vector<SymbolId> ids = Warm(client);
+
+  std::vector<Order> orders;
+  for (size_t i = 0; i < OrderCount; i++) {
+    orders.push_back(OrderAt(ids, i, client));
+  }
+  std::vector<uint32_t> filled(OrderCount);
+
+  size_t half = OrderCount / 2;
+  uint64_t count = CountAllocations([&]() {
+    for (size_t i = 0; i < half; i++) {
+      client.SubmitOrder(orders[i]);
+    }
+    client.SubmitOrders(&orders[half], OrderCount - half, &filled[half]);
+  });
+  assert(count == 0);
+  assert(client.GetTransactionCount() == OrderCount);
+}
+
+/// Check journaling each fill allocates nothing once the journal is grown.
+void testSubmitJournaled() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  std::string path =
+      "/tmp/AllocationTests_journal_" + std::to_string(getpid());
+  unlink(path.c_str());
+
+  CountingResource resource;
+  BrokerClient client = BrokerClient(1e12, &resource);
+  bool opened = client.OpenJournal(path);
+  assert(opened);
+  (void)opened;
+  std::vector<SymbolId> ids = Warm(client);
+
+  uint64_t count = CountAllocations([&]() {
+    for (size_t i = 0; i < OrderCount; i++) {
+      client.SubmitOrder(OrderAt(ids, i, client));
+    }
+  });
+  assert(count == 0);
+  assert(client.GetTransactionCount() == OrderCount);
+  unlink(path.c_str());
+}
+
+/// Check the order thread allocates nothing in asynchronous cost basis mode.
+void testSubmitAsync() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  CountingResource resource;
+  BrokerClient client = BrokerClient(1e12, &resource);
+  bool enabled = client.EnableAsyncCostBasis();
+  assert(enabled);
+  (void)enabled;
+  std::vector<SymbolId> ids = Warm(client);
+
+  // The worker thread's own allocations aren't counted.
+  uint64_t count = CountAllocations([&]() {
+    for (size_t i = 0; i < OrderCount; i++) {
+      client.SubmitOrder(OrderAt(ids, i, client));
+    }
+  });
+  assert(count == 0);
+  client.Flush();
+}
+
+/// Check reading positions, history and cash allocates nothing.
+void testReaders() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  CountingResource resource;
+  BrokerClient client = BrokerClient(1e12, &resource);
+  std::vector<SymbolId> ids = Warm(client);
+  for (size_t i = 0; i < 1000; i++) {
+    client.SubmitOrder(OrderAt(ids, i, client));
+  }
+  client.GetCachedPositions();
+
+  uint64_t quantity = 0;
+  uint64_t count = CountAllocations([&]() {
+    for (SymbolId symbol : ids) {
+      quantity += client.GetPosition(symbol).quantity;
+    }
+    quantity += client.GetCachedPositions()->size();
+    quantity += client.GetTransactions(500, 100).size();
+    quantity += (uint64_t)client.GetCashBalance();
+  });
+  assert(count == 0 && quantity > 0);
+}
+
+int main(void) {
+  std::cout << "Running AllocationTests" << std::endl;
+  testCountingWorks();
+  testSubmitById();
+  testSubmitByName();
+  testSubmitJournaled();
+  testSubmitAsync();
+  testReaders();
+  std::cout << "All tests passed!" << std::endl;
+}
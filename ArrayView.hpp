@@ -0,0 +1,56 @@
+/**
+ * @file ArrayView.hpp
+ *
+ * Header file describing ArrayView, a non-owning read-only view of a
+ * contiguous array.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @class ArrayView
+ *
+ * Non-owning read-only view of a contiguous array, exposing just enough of
+ * the standard container interface for range-based for loops and indexing.
+ * The view is only valid while the underlying storage is; in particular a
+ * view of a std::vector is invalidated by anything that may reallocate it.
+ */
+template <typename T> class ArrayView {
+public:
+  /// Construct an empty view.
+  ArrayView() : data_(nullptr), size_(0) {}
+
+  /**
+   * Construct a view of an array.
+   *
+   * @param[in] data
+   *    Pointer to the first element of the array.
+   *
+   * @param[in] size
+   *    Number of elements in the array.
+   */
+  ArrayView(const T *data, size_t size) : data_(data), size_(size) {}
+
+  const T *begin() const { return data_; }
+  const T *end() const { return data_ + size_; }
+  const T *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const T &operator[](size_t index) const { return data_[index]; }
+
+  /**
+   * Copy the viewed elements into a vector, for callers that need to keep
+   * them beyond the lifetime of the view.
+   */
+  operator std::vector<T>() const { return std::vector<T>(begin(), end()); }
+
+private:
+  /// Pointer to the first viewed element.
+  const T *data_;
+
+  /// Number of viewed elements.
+  size_t size_;
+};
@@ -1,163 +1,944 @@
 /**
  * @file brokerClient.hpp
  *
- * File containing the implementation of the BrokerClient interface.
+ * File containing the implementation of the BrokerClient interface, for each
+ * cost basis policy.
  */
 
 #include "BrokerClient.hpp"
+#include "Checkpoint.hpp"
+#include "CostBasisWorker.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <unistd.h>
 
-BrokerClient::BrokerClient(double cashBalance) : cashBalance_(cashBalance) {}
+/// Index of a security that has no entry in the position cache.
+static const size_t NotCached = SIZE_MAX;
+
+/// Number of independent running totals kept by ValuateColumns.
+static const size_t ValuationLanes = 8;
+
+/**
+ * Value columns of positions at market prices, as for
+ * BasicBrokerClient::Valuate, but without weights.
+ *
+ * The totals are kept in ValuationLanes independent lanes, summed only at
+ * the end. A single running total would force the additions to happen in
+ * order, one at a time, where separate lanes can be added in parallel as a
+ * vector, and still sum the same way on every call.
+ *
+ * @param[in] count
+ *    Number of positions.
+ *
+ * @param[in] quantities
+ *    Quantity held of each position.
+ *
+ * @param[in] costs
+ *    Total cost of each position.
+ *
+ * @param[in] prices
+ *    Current price per share of each position.
+ *
+ * @param[out] marketValues
+ *    Market value of each position.
+ *
+ * @param[out] unrealizedPnL
+ *    Unrealized profit or loss of each position.
+ *
+ * @retval
+ *    The totals across every position.
+ */
+static Valuation ValuateColumns(size_t count,
+                                const double *__restrict quantities,
+                                const double *__restrict costs,
+                                const double *__restrict prices,
+                                double *__restrict marketValues,
+                                double *__restrict unrealizedPnL) {
+  double laneValue[ValuationLanes] = {};
+  double laneCost[ValuationLanes] = {};
+  size_t i = 0;
+  for (; i + ValuationLanes <= count; i += ValuationLanes) {
+    for (size_t lane = 0; lane < ValuationLanes; lane++) {
+      double value = quantities[i + lane] * prices[i + lane];
+      marketValues[i + lane] = value;
+      unrealizedPnL[i + lane] = value - costs[i + lane];
+      laneValue[lane] += value;
+      laneCost[lane] += costs[i + lane];
+    }
+  }
+  for (; i < count; i++) {
+    double value = quantities[i] * prices[i];
+    marketValues[i] = value;
+    unrealizedPnL[i] = value - costs[i];
+    laneValue[0] += value;
+    laneCost[0] += costs[i];
+  }
+
+  Valuation total = {.marketValue = 0, .costBasis = 0, .unrealizedPnL = 0};
+  for (size_t lane = 0; lane < ValuationLanes; lane++) {
+    total.marketValue += laneValue[lane];
+    total.costBasis += laneCost[lane];
+  }
+  total.unrealizedPnL = total.marketValue - total.costBasis;
+  return total;
+}
+
+/// Maximum number of released vectors of positions kept for reuse.
+static const size_t MaxSparePositions = 2;
+
+/**
+ * Struct holding a vector of positions built by the position cache, along
+ * with what it was built from.
+ */
+struct PositionBuffer {
+  /// The positions.
+  std::vector<SecurityPosition> positions;
+
+  /// Number of the cache update that built the positions.
+  uint64_t update = 0;
+
+  /// Number of the rebuild whose layout of entries the positions have.
+  uint64_t layout = 0;
+};
+
+/**
+ * Struct holding the vectors of positions that callers of
+ * GetCachedPositions have released, for the cache to reuse. It is shared by
+ * the cache and every vector handed out, so it outlives whichever goes last.
+ */
+struct PositionRecycler {
+  /// Guards spare.
+  std::mutex mutex;
+
+  /// Released vectors, which nothing else refers to any more.
+  std::vector<std::unique_ptr<PositionBuffer>> spare;
+};
+
+/**
+ * Deleter of the vectors handed out by GetCachedPositions, returning them
+ * to the cache once the last reference to them is dropped.
+ */
+struct PositionReturner {
+  /// Where released vectors go.
+  std::shared_ptr<PositionRecycler> recycler;
+
+  void operator()(PositionBuffer *buffer) const {
+    std::unique_ptr<PositionBuffer> owned(buffer);
+    std::lock_guard<std::mutex> lock(recycler->mutex);
+    if (recycler->spare.size() < MaxSparePositions) {
+      recycler->spare.push_back(std::move(owned));
+    }
+  }
+};
+
+/**
+ * Struct holding the cache behind BasicBrokerClient::GetCachedPositions.
+ */
+struct PositionCache {
+  /// Guards the rest of the cache.
+  std::mutex mutex;
+
+  /// The cached positions, or null if they haven't been built yet.
+  std::shared_ptr<const std::vector<SecurityPosition>> positions;
+
+  /// Buffer holding positions, which is never modified once handed out.
+  const PositionBuffer *current = nullptr;
+
+  /// Vectors released by callers, ready to be reused.
+  std::shared_ptr<PositionRecycler> recycler =
+      std::make_shared<PositionRecycler>();
+
+  /// Number of updates made, which is the update that built current.
+  uint64_t updates = 0;
+
+  /// Number of rebuilds made, which is the layout of current.
+  uint64_t layouts = 0;
+
+  /// Index into positions of each security's entry, or NotCached.
+  std::vector<size_t> index;
+
+  /// Version of the snapshots the cache was last brought up to date with.
+  uint64_t version = 0;
+
+  /// Securities published since the last update, reused between updates.
+  std::vector<SymbolId> dirty;
+
+  /// Securities changed by the update that built current.
+  std::vector<SymbolId> lastDirty;
+
+  /// Positions of the securities in dirty, reused between updates.
+  std::vector<PositionSnapshot> snapshots;
+};
+
+template <typename Lots>
+BasicBrokerClient<Lots>::BasicBrokerClient(double cashBalance,
+                                           MemoryResource *resource)
+    : cashBalance_(ToMoney(cashBalance)), realizedPnL_(0),
+      snapshots_(new PositionSnapshots()),
+      positionCache_(new PositionCache()), symbols_(resource),
+      portfolio_(PolyAllocator<State>(resource)),
+      quantityColumn_(PolyAllocator<double>(resource)),
+      costColumn_(PolyAllocator<double>(resource)),
+      publishedCosts_(PolyAllocator<double>(resource)),
+      batchSymbols_(PolyAllocator<SymbolId>(resource)),
+      transactions_(PolyAllocator<Order>(resource)) {
+  snapshots_->PublishCash(cashBalance_);
+}
+
+// Defined here, where CostBasisWorker is a complete type.
+template <typename Lots>
+BasicBrokerClient<Lots>::~BasicBrokerClient() = default;
+template <typename Lots>
+BasicBrokerClient<Lots>::BasicBrokerClient(BasicBrokerClient &&) = default;
+template <typename Lots>
+BasicBrokerClient<Lots> &
+BasicBrokerClient<Lots>::operator=(BasicBrokerClient &&) = default;
+
+template <typename Lots>
+SymbolId BasicBrokerClient<Lots>::InternSymbol(Ticker name) {
+  // Refuse names too long to be represented.
+  if (!name.Valid()) {
+    return InvalidSymbolId;
+  }
+  SymbolId symbol = symbols_.Intern(name);
+
+  // Give newly seen securities an empty state record.
+  if (symbol == portfolio_.size()) {
+    MemoryResource *resource = portfolio_.get_allocator().Resource();
+    State state = {.quantity = 0,
+                   .totalCost = 0,
+                   .realizedPnL = 0,
+                   .lots = Lots(resource),
+                   .lastFill = 0};
+    portfolio_.push_back(std::move(state));
+    quantityColumn_.push_back(0);
+    costColumn_.push_back(0);
+    if (batchSymbols_.capacity() < portfolio_.size()) {
+      batchSymbols_.reserve(portfolio_.capacity());
+    }
+    snapshots_->Add(symbols_.Name(symbol));
+  }
+  return symbol;
+}
+
+template <typename Lots>
+uint32_t BasicBrokerClient<Lots>::SubmitOrder(const Order &order) {
+  /*
+   * Resolve the security name to its id. Buying a security we haven't seen
+   * before assigns it a new id; selling one can never succeed, so there is
+   * no need to intern it.
+   */
+  SymbolId symbol;
+  if (order.kind == Buy) {
+    symbol = InternSymbol(order.position.name);
+  } else {
+    symbol = symbols_.Find(order.position.name);
+  }
+  if (symbol == InvalidSymbolId) {
+    return 0;
+  }
+
+  return SubmitOrder(order.kind, symbol, order.position.quantity,
+                     order.position.price);
+}
+
+template <typename Lots>
+void BasicBrokerClient<Lots>::SubmitOrders(const Order *orders, size_t count,
+                                           uint32_t *filled) {
+  // Reserve history space up front, still growing geometrically.
+  size_t required = transactions_.size() + count;
+  if (required > transactions_.capacity()) {
+    transactions_.reserve(std::max(required, 2 * transactions_.capacity()));
+  }
+
+  /*
+   * Leave publication to the end of the batch. A security is noted the
+   * first time the batch fills it, i.e. when its last fill predates the
+   * batch.
+   */
+  batching_ = true;
+  batchStart_ = GetSequenceNumber();
+
+  // Id of the previous order's security, reused while the name repeats.
+  Ticker lastName;
+  SymbolId symbol = InvalidSymbolId;
+
+  for (size_t i = 0; i < count; i++) {
+    const Order &order = orders[i];
+    if (i == 0 || order.position.name != lastName) {
+      lastName = order.position.name;
+      symbol = symbols_.Find(order.position.name);
+    }
+
+    // As in SubmitOrder, only buys may introduce a new security.
+    if (symbol == InvalidSymbolId) {
+      if (order.kind == Sell) {
+        filled[i] = 0;
+        continue;
+      }
+      symbol = InternSymbol(order.position.name);
+      if (symbol == InvalidSymbolId) {
+        filled[i] = 0;
+        continue;
+      }
+    }
+
+    filled[i] = SubmitOrder(order.kind, symbol, order.position.quantity,
+                            order.position.price);
+  }
+
+  batching_ = false;
+  for (SymbolId changed : batchSymbols_) {
+    Publish(changed);
+  }
+  batchSymbols_.clear();
+}
+
+template <typename Lots>
+bool BasicBrokerClient<Lots>::Reserve(size_t fills) {
+  if (journal_ && !journal_->Reserve(fills)) {
+    return false;
+  }
+  transactions_.reserve(transactions_.size() + fills);
+  return true;
+}
+
+template <typename Lots>
+uint32_t BasicBrokerClient<Lots>::SubmitOrder(OrderKind kind, SymbolId symbol,
+                                              uint32_t quantity,
+                                              double price) {
+  assert(symbol < symbols_.Size());
+
+  /*
+   * Convert the price once, here at the boundary, so that the rest of the
+   * order is processed entirely in Money. The transaction history records
+   * the price actually used.
+   */
+  Money tickPrice = ToMoney(price);
+  price = FromMoney(tickPrice);
+
+  // Make sure any fill can be journaled before making it.
+  if (journal_ && !journal_->Reserve(1)) {
+    return 0;
+  }
 
-uint32_t BrokerClient::SubmitOrder(Order order) {
   // Return value will be stored in here.
   uint32_t quantityTransacted = 0;
 
   // If we end up making a transaction, it will be stored in here.
   Order completedOrder = {};
 
-  switch (order.kind) {
+  switch (kind) {
   case Buy: {
     // Don't overdraw our cash balance on a buy order.
-    quantityTransacted = std::min((double)order.position.quantity,
-                                  GetCashBalance() / order.position.price);
+    quantityTransacted = AffordableQuantity(cashBalance_, tickPrice, quantity);
     if (quantityTransacted == 0) {
       break;
     }
 
-    completedOrder.kind = order.kind;
-    SecurityPosition position = {.name = order.position.name,
+    completedOrder.kind = kind;
+    SecurityPosition position = {.name = symbols_.Name(symbol),
                                  .quantity = quantityTransacted,
-                                 .price = order.position.price};
+                                 .price = price};
     completedOrder.position = position;
 
     // Update internal state from the newly processed order.
-    HandleBuy(completedOrder);
+    HandleBuy(symbol, completedOrder, tickPrice);
+    RecordFill(completedOrder);
     break;
   }
   case Sell: {
     // Don't sell shared we don't have.
-    if (portfolio_.find(order.position.name) == portfolio_.end()) {
+    if (portfolio_[symbol].quantity == 0) {
       quantityTransacted = 0;
       break;
     } else {
-      quantityTransacted = std::min(order.position.quantity,
-                                    portfolio_[order.position.name].quantity);
+      quantityTransacted = std::min(quantity, portfolio_[symbol].quantity);
     }
 
-    completedOrder.kind = order.kind;
-    SecurityPosition position = {.name = order.position.name,
+    completedOrder.kind = kind;
+    SecurityPosition position = {.name = symbols_.Name(symbol),
                                  .quantity = quantityTransacted,
-                                 .price = order.position.price};
+                                 .price = price};
     completedOrder.position = position;
 
     // Update internal state from the newly processed order.
-    HandleSell(completedOrder);
+    HandleSell(symbol, completedOrder, tickPrice);
+    RecordFill(completedOrder);
     break;
   }
   }
   return quantityTransacted;
 }
 
-void BrokerClient::HandleBuy(Order order) {
-  assert(order.kind == Buy);
+template <typename Lots>
+void BasicSymbolState<Lots>::Buy(uint32_t boughtQuantity, Money price) {
+  /*
+   * Update the position. Only the running totals are kept, so there's no
+   * weighted average to recompute here.
+   */
+  quantity += boughtQuantity;
+  totalCost += price * boughtQuantity;
 
   /*
-   * Update portfolio, either adding a new entry or re-computing the existing
-   * entry.
+   * Hand the purchased shares to the policy as a new lot, which it may keep
+   * or, for average cost, ignore.
    */
-  if (portfolio_.find(order.position.name) != portfolio_.end()) {
-    SecurityPosition &position = portfolio_[order.position.name];
-    /*
-     * If we already own some of this security, we calculate the portfolio
-     * price as the average buy price across all buy orders (a weighted
-     * average on a per-share basis)
-     */
-    double weightedPrice =
-        ((double)((order.position.quantity * order.position.price) +
-                  (position.quantity * position.price)) /
-         (double)(order.position.quantity + position.quantity));
-    position.quantity += order.position.quantity;
-    position.price = weightedPrice;
+  Lot lot = {.quantity = boughtQuantity, .price = price};
+  lots.Push(lot);
+}
+
+template <typename Lots>
+Money BasicSymbolState<Lots>::Sell(uint32_t soldQuantity, Money price) {
+  assert(soldQuantity <= quantity);
+
+  /*
+   * Update the lots from which we calculate the current weighted average
+   * cost basis (price) for the given security. This is done by consuming
+   * lots in the order the policy chooses (oldest, newest or most expensive
+   * first), until we've removed as many shares worth of lots as we are
+   * selling in this transaction. Average cost keeps no lots, and removes its
+   * share of the total cost instead.
+   */
+  Money buyValueRemoved = lots.Consume(soldQuantity, quantity, totalCost);
+
+  /*
+   * Update the position's running totals. If we've sold everything, the
+   * whole remaining cost is removed instead, so that no rounding residue is
+   * carried over into a future position, and the sale realizes it.
+   */
+  quantity -= soldQuantity;
+  if (quantity == 0) {
+    buyValueRemoved = totalCost;
+    totalCost = 0;
   } else {
-    SecurityPosition position = order.position;
-    portfolio_.insert(std::make_pair(order.position.name, position));
+    totalCost -= buyValueRemoved;
   }
 
+  // The sale realizes its proceeds less the cost of the shares it took.
+  Money realized = price * soldQuantity - buyValueRemoved;
+  realizedPnL += realized;
+  return realized;
+}
+
+template <typename Lots>
+void BasicBrokerClient<Lots>::HandleBuy(SymbolId symbol, const Order &order,
+                                        Money price) {
+  assert(order.kind == Buy);
+  State &state = portfolio_[symbol];
+  transactions_.push_back(order);
+  uint64_t previousFill = state.lastFill;
+  state.lastFill = GetSequenceNumber();
+
   /*
-   * Insert the order into the specific outstanding buy order queue for the
-   * given security.
+   * In asynchronous cost basis mode only the quantity is kept here, and the
+   * lot is left to the worker.
    */
-  if (outstandingBuyOrderMap_.find(order.position.name) ==
-      outstandingBuyOrderMap_.end()) {
-    std::queue<Order> queue;
-    outstandingBuyOrderMap_.insert(std::make_pair(order.position.name, queue));
+  if (costBasis_) {
+    state.quantity += order.position.quantity;
+    costBasis_->Enqueue(Buy, symbol, order.position.quantity, price,
+                        state.lastFill);
+  } else {
+    state.Buy(order.position.quantity, price);
   }
-  outstandingBuyOrderMap_[order.position.name].push(order);
 
   // Decrease cash by the amount we purchased.
-  cashBalance_ -= order.position.price * order.position.quantity;
-  transactions_.push_back(order);
+  cashBalance_ -= price * order.position.quantity;
+  PublishFill(symbol, previousFill);
 }
 
-void BrokerClient::HandleSell(Order order) {
+template <typename Lots>
+void BasicBrokerClient<Lots>::HandleSell(SymbolId symbol,
+                                         const Order &order, Money price) {
   assert(order.kind == Sell);
+  State &state = portfolio_[symbol];
+  transactions_.push_back(order);
+  uint64_t previousFill = state.lastFill;
+  state.lastFill = GetSequenceNumber();
+
+  /*
+   * In asynchronous cost basis mode, consuming lots (the expensive part of
+   * a sale) is left to the worker.
+   */
+  if (costBasis_) {
+    state.quantity -= order.position.quantity;
+    costBasis_->Enqueue(Sell, symbol, order.position.quantity, price,
+                        state.lastFill);
+  } else {
+    realizedPnL_ += state.Sell(order.position.quantity, price);
+  }
+
+  // Increase cash by the amount we sold.
+  cashBalance_ += price * order.position.quantity;
+  PublishFill(symbol, previousFill);
+}
+
+template <typename Lots>
+void BasicBrokerClient<Lots>::RecordFill(const Order &order) {
+  if (!journal_) {
+    return;
+  }
+  journal_->Append(order.kind, order.position.name, order.position.quantity,
+                   order.position.price);
+
+  uint64_t sequence = GetSequenceNumber();
+  if (checkpointInterval_ != 0 && sequence % checkpointInterval_ == 0) {
+    /*
+     * Only copy the state here, and leave writing, syncing and renaming the
+     * file to the writer. It keeps this checkpoint and the one before it,
+     * and drops any older one once this one is written.
+     */
+    std::vector<char> buffer;
+    SerializeCheckpoint(&buffer);
+    checkpointWriter_->Write(checkpointDirectory_, sequence, buffer);
+  }
+}
+
+template <typename Lots>
+bool BasicBrokerClient<Lots>::OpenJournal(const std::string &path) {
+  return OpenJournal(path, std::string(), 0);
+}
+
+template <typename Lots>
+bool BasicBrokerClient<Lots>::OpenJournal(
+    const std::string &path, const std::string &checkpointDirectory,
+    uint64_t checkpointInterval) {
+  if (journal_ || costBasis_ || !transactions_.empty()) {
+    return false;
+  }
+
+  std::unique_ptr<TransactionJournal> journal(new TransactionJournal());
+  if (!journal->Open(path, GetCashBalance())) {
+    return false;
+  }
+  journal_ = std::move(journal);
+  checkpointDirectory_ = checkpointDirectory;
+  checkpointInterval_ = checkpointInterval;
+  if (checkpointInterval != 0) {
+    checkpointWriter_.reset(new CheckpointWriter());
+  }
 
   /*
-   * Update the buy orders from which we calculate the current weighted
-   * average cost basis (price) for the given security. This is done by
-   * removing buy orders from a FIFO queue, until we've removed as many
-   * shares worth of buy orders as we are selling in this transaction.
+   * Start from the newest usable checkpoint, if there is one, falling back
+   * on older ones if it can't be loaded. A checkpoint later than the end of
+   * the journal (e.g. if the journal's tail was lost) can't be used, since
+   * the fills leading up to it can't be replayed.
    */
-  double buyValueRemoved = 0;
-  uint32_t buyQuantityRemoved = 0;
-  std::queue<Order> &buyOrderQueue =
-      outstandingBuyOrderMap_[order.position.name];
-  while (buyQuantityRemoved < order.position.quantity) {
-    Order &buyOrder = buyOrderQueue.front();
-
-    // Either consume a complete or partial buy order.
-    if ((order.position.quantity - buyQuantityRemoved) >=
-        buyOrder.position.quantity) {
-      buyQuantityRemoved += buyOrder.position.quantity;
-      buyValueRemoved += buyOrder.position.quantity * buyOrder.position.price;
-      buyOrderQueue.pop();
+  uint64_t sequence = 0;
+  uint64_t journalLength = journal_->Records().size();
+  cashBalance_ = ToMoney(journal_->InitialCash());
+  snapshots_->PublishCash(cashBalance_);
+  std::vector<uint64_t> checkpoints;
+  if (!checkpointDirectory.empty() &&
+      ListCheckpoints(checkpointDirectory, &checkpoints)) {
+    for (size_t i = checkpoints.size(); i-- > 0;) {
+      if (checkpoints[i] <= journalLength &&
+          LoadCheckpoint(CheckpointPath(checkpointDirectory, checkpoints[i]))) {
+        sequence = checkpoints[i];
+        break;
+      }
+    }
+  }
+  ReplayJournal(sequence);
+  return true;
+}
+
+template <typename Lots>
+bool BasicBrokerClient<Lots>::WriteCheckpoint(const std::string &path) const {
+  std::vector<char> buffer;
+  SerializeCheckpoint(&buffer);
+  return WriteFileAtomically(path, buffer.data(), buffer.size());
+}
+
+template <typename Lots>
+void BasicBrokerClient<Lots>::SerializeCheckpoint(
+    std::vector<char> *buffer) const {
+  size_t lotCount = 0;
+  for (const State &state : portfolio_) {
+    lotCount += state.lots.Size();
+  }
+
+  // Lay the checkpoint out in memory exactly as it will be mapped.
+  buffer->resize(sizeof(CheckpointHeader) +
+                 portfolio_.size() * sizeof(CheckpointSymbol) +
+                 lotCount * sizeof(Lot));
+  CheckpointHeader *header =
+      reinterpret_cast<CheckpointHeader *>(buffer->data());
+  CheckpointSymbol *records = reinterpret_cast<CheckpointSymbol *>(header + 1);
+  Lot *lots = reinterpret_cast<Lot *>(records + portfolio_.size());
+
+  InitCheckpointHeader(header);
+  header->sequence = GetSequenceNumber();
+  header->cashBalance = cashBalance_;
+  header->symbolCount = portfolio_.size();
+  header->lotCount = lotCount;
+  header->costBasisPolicy = Lots::PolicyId;
+  header->realizedPnL = realizedPnL_;
+
+  uint64_t nextLot = 0;
+  for (SymbolId symbol = 0; symbol < portfolio_.size(); symbol++) {
+    const State &state = portfolio_[symbol];
+    CheckpointSymbol &record = records[symbol];
+    memcpy(record.name, symbols_.Name(symbol).Data(), JournalNameLength);
+    record.quantity = state.quantity;
+    record.lotCount = (uint32_t)state.lots.Size();
+    record.totalCost = state.totalCost;
+    record.realizedPnL = state.realizedPnL;
+    record.firstLot = nextLot;
+    state.lots.CopyTo(lots + nextLot);
+    nextLot += state.lots.Size();
+  }
+}
+
+template <typename Lots>
+bool BasicBrokerClient<Lots>::FlushCheckpoints() {
+  return !checkpointWriter_ || checkpointWriter_->Flush();
+}
+
+template <typename Lots>
+bool BasicBrokerClient<Lots>::LoadCheckpoint(const std::string &path) {
+  // Lots kept under one policy mean nothing to another.
+  MappedCheckpoint checkpoint;
+  if (!checkpoint.Open(path) ||
+      checkpoint.Header().costBasisPolicy != Lots::PolicyId) {
+    return false;
+  }
+
+  const CheckpointHeader &header = checkpoint.Header();
+  const CheckpointSymbol *records = checkpoint.Symbols();
+  const Lot *lots = checkpoint.Lots();
+  for (uint64_t i = 0; i < header.symbolCount; i++) {
+    const CheckpointSymbol &record = records[i];
+    SymbolId symbol = InternSymbol(Ticker(record.name, JournalNameLength));
+    State &state = portfolio_[symbol];
+    state.quantity = record.quantity;
+    state.totalCost = record.totalCost;
+    state.realizedPnL = record.realizedPnL;
+    state.lots.Assign(lots + record.firstLot, record.lotCount);
+    Publish(symbol);
+  }
+
+  cashBalance_ = header.cashBalance;
+  snapshots_->PublishCash(cashBalance_);
+  realizedPnL_ = header.realizedPnL;
+  sequenceBase_ = header.sequence;
+  return true;
+}
+
+template <typename Lots>
+void BasicBrokerClient<Lots>::ReplayJournal(uint64_t from) {
+  ArrayView<JournalRecord> records = journal_->Records();
+  transactions_.reserve(records.size() - from);
+
+  // Name and id of the previous record's security, reused while it repeats.
+  Ticker name;
+  SymbolId symbol = InvalidSymbolId;
+
+  for (uint64_t i = from; i < records.size(); i++) {
+    const JournalRecord &record = records[i];
+    Ticker recordName(record.name, JournalNameLength);
+    if (symbol == InvalidSymbolId || recordName != name) {
+      name = recordName;
+      symbol = InternSymbol(name);
+    }
+
+    /*
+     * Fills in the journal were validated when they were first made, so
+     * they can be applied directly.
+     */
+    Order order = {.kind = (OrderKind)record.kind,
+                   .position = {.name = name,
+                                .quantity = record.quantity,
+                                .price = record.price}};
+    if (order.kind == Buy) {
+      HandleBuy(symbol, order, ToMoney(record.price));
     } else {
-      buyOrder.position.quantity -=
-          (order.position.quantity - buyQuantityRemoved);
-      buyValueRemoved += ((order.position.quantity - buyQuantityRemoved) *
-                          buyOrder.position.price);
-      buyQuantityRemoved = order.position.quantity;
+      HandleSell(symbol, order, ToMoney(record.price));
     }
   }
+}
+
+template <typename Lots>
+bool BasicBrokerClient<Lots>::EnableAsyncCostBasis() {
+  if (journal_ || costBasis_ || !transactions_.empty()) {
+    return false;
+  }
+  costBasis_.reset(new CostBasisWorker<Lots>());
+  return true;
+}
+
+template <typename Lots>
+void BasicBrokerClient<Lots>::Flush() {
+  if (costBasis_) {
+    costBasis_->Flush();
+  }
+}
+
+template <typename Lots>
+uint64_t BasicBrokerClient<Lots>::GetCostBasisVersion(SymbolId symbol) const {
+  assert(symbol < symbols_.Size());
+  if (costBasis_) {
+    return costBasis_->Get(symbol).version;
+  }
+  return portfolio_[symbol].lastFill;
+}
+
+template <typename Lots>
+double BasicBrokerClient<Lots>::GetRealizedPnL(SymbolId symbol) const {
+  assert(symbol < symbols_.Size());
+  if (costBasis_) {
+    return FromMoney(costBasis_->Get(symbol).realizedPnL);
+  }
+  return FromMoney(portfolio_[symbol].realizedPnL);
+}
+
+template <typename Lots>
+double BasicBrokerClient<Lots>::GetRealizedPnL() const {
+  if (costBasis_) {
+    return FromMoney(costBasis_->GetRealizedPnL());
+  }
+  return FromMoney(realizedPnL_);
+}
+
+template <typename Lots>
+Valuation BasicBrokerClient<Lots>::Valuate(const double *prices,
+                                           double *marketValues,
+                                           double *unrealizedPnL,
+                                           double *weights) const {
+  size_t count = portfolio_.size();
 
   /*
-   * Recompute the portfolio weighted average price for this security. This
-   * is done by computing (newValueTotal / newQuantityTotal), which we can
-   * because we know the old value and quantity, and how much value we just
-   * removed from the current buy order queue above.
+   * In asynchronous cost basis mode, the costs live with the worker, so
+   * gather them as GetPosition would see them first.
    */
-  SecurityPosition &position = portfolio_[order.position.name];
-  position.price =
-      ((double)((position.price * position.quantity) - buyValueRemoved) /
-       (double)(position.quantity - order.position.quantity));
-  position.quantity -= order.position.quantity;
-
-  // If we've sold everything, remove the security from the map.
-  if (position.quantity == 0) {
-    auto it = portfolio_.find(order.position.name);
-    portfolio_.erase(it);
+  const double *costs = costColumn_.data();
+  if (costBasis_) {
+    if (publishedCosts_.size() < count) {
+      publishedCosts_.resize(portfolio_.capacity());
+    }
+    costBasis_->GetAveragePrices(count, publishedCosts_.data());
+    for (size_t i = 0; i < count; i++) {
+      publishedCosts_[i] *= quantityColumn_[i];
+    }
+    costs = publishedCosts_.data();
   }
 
-  // Increase cash by the amount we sold.
-  cashBalance_ += order.position.price * order.position.quantity;
-  transactions_.push_back(order);
+  Valuation total = ValuateColumns(count, quantityColumn_.data(), costs,
+                                   prices, marketValues, unrealizedPnL);
+
+  // Weights need the total, so take a second, equally simple, pass.
+  double scale = total.marketValue != 0 ? 1 / total.marketValue : 0;
+  for (size_t i = 0; i < count; i++) {
+    weights[i] = marketValues[i] * scale;
+  }
+  return total;
 }
 
-std::vector<SecurityPosition> BrokerClient::GetPositions() {
+template <typename Lots>
+std::vector<SecurityPosition> BasicBrokerClient<Lots>::GetPositions() const {
   std::vector<SecurityPosition> positions;
-  for (auto it = portfolio_.begin(); it != portfolio_.end(); it++) {
-    positions.push_back(it->second);
+  size_t count = snapshots_->Size();
+  for (SymbolId symbol = 0; symbol < count; symbol++) {
+    SecurityPosition position = GetPosition(symbol);
+    if (position.quantity != 0) {
+      positions.push_back(position);
+    }
   }
   return positions;
 }
+
+template <typename Lots>
+SecurityPosition BasicBrokerClient<Lots>::GetPosition(SymbolId symbol) const {
+  /*
+   * Read the published copy of the position rather than the portfolio
+   * itself, so that this is safe from any thread.
+   */
+  assert(symbol < snapshots_->Size());
+  PositionSnapshot snapshot = snapshots_->Read(symbol);
+  SecurityPosition position = {.name = snapshots_->Name(symbol),
+                               .quantity = snapshot.quantity,
+                               .price = 0};
+  if (snapshot.quantity == 0) {
+    return position;
+  }
+
+  /*
+   * In asynchronous cost basis mode, take the price from the worker's last
+   * published cost basis, which may be a few fills behind the quantity.
+   */
+  if (costBasis_) {
+    CostBasis basis = costBasis_->Get(symbol);
+    if (basis.quantity != 0) {
+      position.price = AveragePrice(basis.totalCost, basis.quantity);
+    }
+  } else {
+    position.price = AveragePrice(snapshot.totalCost, snapshot.quantity);
+  }
+  return position;
+}
+
+template <typename Lots>
+std::shared_ptr<const std::vector<SecurityPosition>>
+BasicBrokerClient<Lots>::GetCachedPositions() const {
+  if (costBasis_) {
+    return std::make_shared<const std::vector<SecurityPosition>>(
+        GetPositions());
+  }
+
+  PositionCache &cache = *positionCache_;
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  uint64_t version = snapshots_->Version();
+  if (cache.positions && version == cache.version) {
+    return cache.positions;
+  }
+
+  /*
+   * Collect every security published since the last update. An update can
+   * just rewrite their entries if they are all still held and already had
+   * entries; otherwise the set of entries changes, and the cache is rebuilt.
+   */
+  size_t count = snapshots_->Size();
+  size_t words = (count + 63) / 64;
+  cache.index.resize(count, NotCached);
+  cache.dirty.clear();
+  bool rebuild = !cache.positions;
+  for (size_t word = 0; word < words; word++) {
+    /*
+     * Securities added after count was read may already be published, but
+     * have no index entry yet, so leave their bits for the next update.
+     */
+    uint64_t mask = ~(uint64_t)0;
+    if (word == words - 1 && count % 64 != 0) {
+      mask = ((uint64_t)1 << (count % 64)) - 1;
+    }
+    uint64_t bits = snapshots_->TakeDirty(word, mask);
+    while (bits != 0) {
+      SymbolId symbol = (SymbolId)(word * 64 + __builtin_ctzll(bits));
+      bits &= bits - 1;
+      cache.dirty.push_back(symbol);
+    }
+  }
+
+  cache.snapshots.clear();
+  for (SymbolId symbol : cache.dirty) {
+    PositionSnapshot snapshot = snapshots_->Read(symbol);
+    cache.snapshots.push_back(snapshot);
+    if ((cache.index[symbol] == NotCached) != (snapshot.quantity == 0)) {
+      rebuild = true;
+    }
+  }
+
+  /*
+   * Never modify a vector that has been handed out. Build the new positions
+   * in a vector a caller has released instead, which the recycler's lock
+   * hands over to us once nothing else can refer to it, or else a new one.
+   */
+  std::unique_ptr<PositionBuffer> buffer;
+  {
+    std::lock_guard<std::mutex> lock(cache.recycler->mutex);
+    if (!cache.recycler->spare.empty()) {
+      buffer = std::move(cache.recycler->spare.back());
+      cache.recycler->spare.pop_back();
+    }
+  }
+  if (!buffer) {
+    buffer.reset(new PositionBuffer());
+  }
+  std::vector<SecurityPosition> &positions = buffer->positions;
+
+  if (rebuild) {
+    cache.layouts++;
+    positions.clear();
+    for (SymbolId symbol = 0; symbol < count; symbol++) {
+      cache.index[symbol] = NotCached;
+      PositionSnapshot snapshot = snapshots_->Read(symbol);
+      if (snapshot.quantity != 0) {
+        cache.index[symbol] = positions.size();
+        SecurityPosition position = {
+            .name = snapshots_->Name(symbol),
+            .quantity = snapshot.quantity,
+            .price = AveragePrice(snapshot.totalCost, snapshot.quantity)};
+        positions.push_back(position);
+      }
+    }
+  } else {
+    /*
+     * A vector built by the update before the current one, with the same
+     * layout, only lacks the entries that update changed. Any other is
+     * brought up to date by copying the current positions.
+     */
+    const PositionBuffer &current = *cache.current;
+    if (buffer->layout == cache.layouts &&
+        buffer->update + 1 == cache.updates) {
+      for (SymbolId symbol : cache.lastDirty) {
+        size_t entry = cache.index[symbol];
+        if (entry != NotCached) {
+          positions[entry] = current.positions[entry];
+        }
+      }
+    } else {
+      positions = current.positions;
+    }
+    for (size_t i = 0; i < cache.dirty.size(); i++) {
+      /*
+       * A security with no entry that changed and is still not held (i.e.
+       * was bought and sold out again since the last update) has nothing to
+       * rewrite.
+       */
+      size_t entry = cache.index[cache.dirty[i]];
+      if (entry == NotCached) {
+        continue;
+      }
+      const PositionSnapshot &snapshot = cache.snapshots[i];
+      SecurityPosition &position = positions[entry];
+      position.quantity = snapshot.quantity;
+      position.price = AveragePrice(snapshot.totalCost, snapshot.quantity);
+    }
+  }
+
+  cache.updates++;
+  buffer->update = cache.updates;
+  buffer->layout = cache.layouts;
+  cache.lastDirty.swap(cache.dirty);
+  cache.current = buffer.get();
+  std::shared_ptr<PositionBuffer> owner(buffer.release(),
+                                        PositionReturner{cache.recycler});
+  cache.positions =
+      std::shared_ptr<const std::vector<SecurityPosition>>(owner,
+                                                           &owner->positions);
+  cache.version = version;
+  return cache.positions;
+}
+
+template <typename Lots>
+SecurityPosition BasicBrokerClient<Lots>::GetPosition(Ticker name) const {
+  SymbolId symbol = symbols_.Find(name);
+  if (symbol == InvalidSymbolId) {
+    SecurityPosition position = {.name = name, .quantity = 0, .price = 0};
+    return position;
+  }
+  return GetPosition(symbol);
+}
+
+template <typename Lots>
+ArrayView<Order> BasicBrokerClient<Lots>::GetTransactions(size_t from,
+                                                          size_t count) const {
+  if (from >= transactions_.size()) {
+    return ArrayView<Order>();
+  }
+  count = std::min(count, transactions_.size() - from);
+  return ArrayView<Order>(transactions_.data() + from, count);
+}
+
+template struct BasicSymbolState<LotQueue>;
+template struct BasicSymbolState<LotStack>;
+template struct BasicSymbolState<LotHeap>;
+template struct BasicSymbolState<AverageCost>;
+template class BasicBrokerClient<LotQueue>;
+template class BasicBrokerClient<LotStack>;
+template class BasicBrokerClient<LotHeap>;
+template class BasicBrokerClient<AverageCost>;
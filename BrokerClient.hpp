@@ -5,11 +5,27 @@
  * selling securities as well as querying positions and orders.
  */
 
-#include <map>
-#include <queue>
+#pragma once
+
+#include "AlignedAllocator.hpp"
+#include "ArrayView.hpp"
+#include "CostBasisPolicies.hpp"
+#include "MemoryResource.hpp"
+#include "Money.hpp"
+#include "PositionSnapshots.hpp"
+#include "SymbolTable.hpp"
+#include "Ticker.hpp"
+#include "TransactionJournal.hpp"
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+class CheckpointWriter;
+template <typename Lots> class CostBasisWorker;
+struct PositionCache;
+
 /**
  * Enumeration describing the different varieties of order that may be placed.
  */
@@ -25,8 +41,8 @@ enum OrderKind {
  * Struct representing a holding of a certain security.
  */
 typedef struct {
-  /// String representing the ticker name of the security.
-  std::string name;
+  /// Ticker name of the security.
+  Ticker name;
 
   /// Quantity of shares of the given security in this position.
   uint32_t quantity;
@@ -47,24 +63,135 @@ typedef struct {
   SecurityPosition position;
 } Order;
 
+static_assert(std::is_trivially_copyable<Order>::value,
+              "orders must be plain data, copyable with memcpy");
+
+/**
+ * Struct representing the totals of a portfolio valued at market prices.
+ */
+typedef struct {
+  /// Total market value of every position.
+  double marketValue;
+
+  /// Total purchase cost of every position.
+  double costBasis;
+
+  /// Total unrealized profit or loss, i.e. market value less cost basis.
+  double unrealizedPnL;
+} Valuation;
+
 /**
- * @class BrokerClient
+ * Struct holding all of the client's state for a single security, so that
+ * processing an order touches one contiguous record. Records are aligned to a
+ * cache line so that neighbouring securities never share one.
+ *
+ * @tparam Lots
+ *    Cost basis policy holding the security's open lots, as described in
+ *    CostBasisPolicies.hpp.
+ */
+template <typename Lots> struct alignas(CacheLineSize) BasicSymbolState {
+  /// Quantity of shares of the security currently held.
+  uint32_t quantity;
+
+  /**
+   * Total purchase cost of the shares currently held. The weighted average
+   * price is only derived from this, by dividing by quantity, when a
+   * position is read.
+   */
+  Money totalCost;
+
+  /**
+   * Cumulative realized profit or loss of every sale of the security, i.e.
+   * their proceeds less the cost of the shares they took.
+   */
+  Money realizedPnL;
+
+  /**
+   * Lots left over from buy orders for the security that have not yet had
+   * their contents sold, kept as the policy requires. This is necessary for
+   * calculating the weighted average of the security's price after a sale.
+   */
+  Lots lots;
+
+  /**
+   * Sequence number of the most recent fill in the security, i.e. the
+   * client's sequence number just after it, or zero if there has been none.
+   */
+  uint64_t lastFill;
+
+  /**
+   * Add bought shares to the position, as a new lot.
+   *
+   * @param[in] boughtQuantity
+   *    Quantity of shares bought.
+   *
+   * @param[in] price
+   *    Price per share at which they were bought.
+   */
+  void Buy(uint32_t boughtQuantity, Money price);
+
+  /**
+   * Remove sold shares from the position, taking them from whichever lots
+   * the policy chooses, and realize the profit or loss of the sale.
+   *
+   * @note
+   *    The position must hold at least as many shares as are sold.
+   *
+   * @param[in] soldQuantity
+   *    Quantity of shares sold.
+   *
+   * @param[in] price
+   *    Price per share at which they were sold.
+   *
+   * @retval
+   *    The profit or loss realized by the sale.
+   */
+  Money Sell(uint32_t soldQuantity, Money price);
+};
+
+/// State of a security under the default, FIFO, cost basis policy.
+typedef BasicSymbolState<LotQueue> SymbolState;
+
+/**
+ * @class BasicBrokerClient
  *
  * This class describes an interface that can be used to buy and sell securities
  * (in whole quantities only) as well as retrieve transaction history, and
  * current portfolio position.
  *
  * The interface manages a cash balance which cannot be overdrawn.
+ *
+ * The client is meant to be driven by a single thread. The exceptions are
+ * GetPositions, GetPosition by id and GetCashBalance, which read copies of
+ * the positions and cash balance published as each order is processed, and
+ * so may also be called from any other thread at any time, without locks
+ * and without ever stalling order processing.
+ *
+ * The client is compiled for the cost basis policy it is given, which
+ * decides which lots each sale takes. BrokerClient uses FIFO, and
+ * LifoBrokerClient, HifoBrokerClient and AverageCostBrokerClient the others.
+ *
+ * @tparam Lots
+ *    Cost basis policy, as described in CostBasisPolicies.hpp.
  */
-class BrokerClient {
+template <typename Lots> class BasicBrokerClient {
 public:
   /**
-   * Constructor for the BrokerClient.
+   * Constructor for the BasicBrokerClient.
    *
    * @param[in] cashBalance
    *    The initial amount of cash that the client will be instantiated with.
+   *
+   * @param[in] resource
+   *    Resource from which the client's history, portfolio, lots and symbol
+   *    table are allocated, which must outlive the client, or null for the
+   *    heap. Giving each short-lived client an ArenaResource lets all of its
+   *    memory be freed at once.
    */
-  BrokerClient(double cashBalance);
+  BasicBrokerClient(double cashBalance, MemoryResource *resource = nullptr);
+  ~BasicBrokerClient();
+  BasicBrokerClient(BasicBrokerClient &&);
+  BasicBrokerClient &operator=(BasicBrokerClient &&);
 
   /**
    * Submit an order to buy or sell a given security. Returns the number
@@ -81,6 +208,10 @@ public:
    * @note
    *    Only whole quantities of securities may be bought or sold.
    *
+   * @note
+   *    Once the security is known and space has been reserved with Reserve
+   *    and ReserveLots, processing an order allocates no memory.
+   *
    * @param[in] order
    *    An Order object representing the necessary details to process the
    *    transaction.
@@ -88,7 +219,105 @@ public:
    * @retval
    *    The number of shares that were bought or sold as part of the order.
    */
-  uint32_t SubmitOrder(Order order);
+  uint32_t SubmitOrder(const Order &order);
+
+  /**
+   * Submit an order to buy or sell a security identified by its SymbolId.
+   * Behaves exactly like SubmitOrder(Order), but skips the ticker name lookup
+   * so that callers on the hot path can avoid string handling entirely.
+   *
+   * @param[in] kind
+   *    Type of the order.
+   *
+   * @param[in] symbol
+   *    Id of the security, as returned by InternSymbol.
+   *
+   * @param[in] quantity
+   *    Quantity of shares to buy or sell.
+   *
+   * @param[in] price
+   *    Price per share at which to buy or sell.
+   *
+   * @retval
+   *    The number of shares that were bought or sold as part of the order.
+   */
+  uint32_t SubmitOrder(OrderKind kind, SymbolId symbol, uint32_t quantity,
+                       double price);
+
+  /**
+   * Submit a batch of orders, processed in sequence. The result is exactly
+   * the same as calling SubmitOrder on each order in turn, but per-order
+   * overheads are amortized across the batch: history space is reserved
+   * once, consecutive orders for the same security share one symbol
+   * lookup, and each position changed and the cash balance are published
+   * to readers once, when the batch is done, rather than after every fill.
+   * Readers on other threads see none of the batch until then.
+   *
+   * @param[in] orders
+   *    Pointer to a contiguous array of orders to process.
+   *
+   * @param[in] count
+   *    Number of orders in the array.
+   *
+   * @param[out] filled
+   *    Pointer to an array of at least count elements, into which the number
+   *    of shares bought or sold for each order is written.
+   */
+  void SubmitOrders(const Order *orders, size_t count, uint32_t *filled);
+
+  /**
+   * Reserve space for a number of further fills in the transaction history,
+   * and in the journal if one is open, so that recording them allocates
+   * nothing.
+   *
+   * @param[in] fills
+   *    Number of fills to reserve space for, beyond those already made.
+   *
+   * @retval
+   *    True if the space was reserved, false if the journal could not be
+   *    grown.
+   */
+  bool Reserve(size_t fills);
+
+  /**
+   * Reserve space for a number of open lots in a security, so that buying
+   * into it allocates nothing until it holds more lots than that. A lot
+   * queue never shrinks, so this only matters until the security's open
+   * lots first reach the number reserved.
+   *
+   * @param[in] symbol
+   *    Id of the security, as returned by InternSymbol.
+   *
+   * @param[in] lots
+   *    Number of open lots to reserve space for.
+   */
+  void ReserveLots(SymbolId symbol, size_t lots) {
+    portfolio_[symbol].lots.Reserve(lots);
+  }
+
+  /**
+   * Get the SymbolId for a ticker name, assigning a new id if the name has
+   * not been seen before. Ids are stable for the lifetime of the client.
+   *
+   * @param[in] name
+   *    Ticker name of the security.
+   *
+   * @retval
+   *    The id to use with the id-based SubmitOrder overload, or
+   *    InvalidSymbolId if the name is longer than Ticker::MaxLength.
+   */
+  SymbolId InternSymbol(Ticker name);
+
+  /**
+   * Get the ticker name for a SymbolId previously returned by InternSymbol.
+   *
+   * @param[in] symbol
+   *    Id of the security.
+   *
+   * @retval
+   *    The ticker name of the security.
+   */
+  Ticker GetSymbolName(SymbolId symbol) const { return symbols_.Name(symbol); }
 
   /**
    * Get the current outstanding positions of the client, i.e.
@@ -103,7 +332,162 @@ public:
    *    A vector of SecurityPosition objects representing the client's
    *    current portfolio.
    */
-  std::vector<SecurityPosition> GetPositions();
+  std::vector<SecurityPosition> GetPositions() const;
+
+  /**
+   * Get the client's current positions, as for GetPositions, but from a
+   * cache that is shared between calls and kept up to date incrementally.
+   * A call when nothing has changed returns the cached vector in O(1), and
+   * otherwise only the positions changed since the last call are read
+   * again, without copying any names, unless a security has been bought
+   * into or sold out of, which rebuilds the cache.
+   *
+   * @note
+   *    A vector once returned never changes, so each update builds a new one,
+   *    reusing a vector callers have released. Releasing each result before
+   *    asking for the next lets an update only rewrite the entries changed
+   *    since, rather than copying every position.
+   *
+   * @note
+   *    In asynchronous cost basis mode, prices change without the client
+   *    knowing, so nothing is cached and every call builds a new vector.
+   *
+   * @retval
+   *    The client's current portfolio, which never changes once returned.
+   */
+  std::shared_ptr<const std::vector<SecurityPosition>>
+  GetCachedPositions() const;
+
+  /**
+   * Get the client's current position in a single security.
+   *
+   * @param[in] symbol
+   *    Id of the security, as returned by InternSymbol.
+   *
+   * @retval
+   *    The client's position in the security, with a quantity and price of
+   *    zero if no shares are held.
+   */
+  SecurityPosition GetPosition(SymbolId symbol) const;
+
+  /**
+   * Get the client's current position in a single security, by name.
+   *
+   * @param[in] name
+   *    Ticker name of the security.
+   *
+   * @retval
+   *    The client's position in the security, with a quantity and price of
+   *    zero if no shares are held.
+   */
+  SecurityPosition GetPosition(Ticker name) const;
+
+  /**
+   * Get the version of the client's position in a security, which is the
+   * sequence number of the most recent fill in it.
+   *
+   * @param[in] symbol
+   *    Id of the security, as returned by InternSymbol.
+   *
+   * @retval
+   *    The sequence number of the last fill in the security, or zero if
+   *    there has been none.
+   */
+  uint64_t GetPositionVersion(SymbolId symbol) const {
+    return portfolio_[symbol].lastFill;
+  }
+
+  /**
+   * Get the version of the price reported for a security's position, which
+   * is the sequence number of the most recent fill reflected in it. The price
+   * is final once this equals GetPositionVersion; it can only lag behind in
+   * asynchronous cost basis mode.
+   *
+   * @param[in] symbol
+   *    Id of the security, as returned by InternSymbol.
+   *
+   * @retval
+   *    The sequence number of the last fill reflected in the price.
+   */
+  uint64_t GetCostBasisVersion(SymbolId symbol) const;
+
+  /**
+   * Get the cumulative realized profit or loss of every sale of a security,
+   * kept up to date as sales are made, so this is O(1). Must be called from
+   * the thread driving the client.
+   *
+   * @note
+   *    In asynchronous cost basis mode, this is as of the last fill the
+   *    worker has published, as for the price of a position. Flush makes it
+   *    final.
+   *
+   * @param[in] symbol
+   *    Id of the security, as returned by InternSymbol.
+   *
+   * @retval
+   *    The proceeds of every sale of the security less the cost of the
+   *    shares sold, or zero if none have been.
+   */
+  double GetRealizedPnL(SymbolId symbol) const;
+
+  /**
+   * Get the cumulative realized profit or loss of every sale in the
+   * account, across all securities, in O(1). Must be called from the thread
+   * driving the client, and is as of the last published fill in
+   * asynchronous cost basis mode, as for GetRealizedPnL(symbol).
+   *
+   * @retval
+   *    The proceeds of every sale less the cost of the shares sold.
+   */
+  double GetRealizedPnL() const;
+
+  /**
+   * Get the number of securities the client has interned, which is one more
+   * than the largest SymbolId handed out.
+   *
+   * @retval
+   *    The number of securities, whether or not any shares are held.
+   */
+  size_t GetSymbolCount() const { return portfolio_.size(); }
+
+  /**
+   * Value every position at market prices, in one pass over columns of the
+   * quantity held and total cost of each security, indexed by SymbolId.
+   * The pass is branch-free and compiles to SIMD instructions, so repricing
+   * a whole account costs a few nanoseconds per security rather than a
+   * GetPositions call and a lookup by name per row. Must be called from the
+   * thread driving the client.
+   *
+   * @note
+   *    Securities with no shares held have a market value, unrealized
+   *    profit or loss and weight of zero, whatever their price.
+   *
+   * @note
+   *    In asynchronous cost basis mode, each cost is the current quantity at
+   *    the position's last published price, as for GetPosition, gathered
+   *    from the worker under one lock before the pass.
+   *
+   * @param[in] prices
+   *    Array of GetSymbolCount() current prices per share, indexed by
+   *    SymbolId.
+   *
+   * @param[out] marketValues
+   *    Array of GetSymbolCount() elements, into which the market value of
+   *    each position is written.
+   *
+   * @param[out] unrealizedPnL
+   *    Array of GetSymbolCount() elements, into which the unrealized profit
+   *    or loss of each position is written.
+   *
+   * @param[out] weights
+   *    Array of GetSymbolCount() elements, into which each position's share
+   *    of the total market value is written, or zeros if that total is zero.
+   *
+   * @retval
+   *    The totals across every position.
+   */
+  Valuation Valuate(const double *prices, double *marketValues,
+                    double *unrealizedPnL, double *weights) const;
 
   /**
    * Get a list of orders that the client submitted and that were
@@ -117,11 +501,42 @@ public:
    *    if they tried to sell more shares than they owned). See the comment
    *    in SubmitOrder for more details.
    *
+   * @note
+   *    The returned view refers directly to the client's history, so this
+   *    is O(1) and copies nothing. It is invalidated by the next order
+   *    submitted; copy it into a std::vector to keep it for longer.
+   *
    * @retval
-   *    A vector of Order objects representing transactions processed by
+   *    A view of Order objects representing transactions processed by
    *    this interface on behalf of the client.
    */
-  std::vector<Order> GetTransactions() { return transactions_; };
+  ArrayView<Order> GetTransactions() const {
+    return ArrayView<Order>(transactions_.data(), transactions_.size());
+  }
+
+  /**
+   * Get a range of the orders that the client submitted and that were
+   * successfully processed, as for GetTransactions().
+   *
+   * @param[in] from
+   *    Index into the history of the first transaction to return.
+   *
+   * @param[in] count
+   *    Maximum number of transactions to return. Fewer are returned if the
+   *    history ends first.
+   *
+   * @retval
+   *    A view of up to count transactions, starting at index from.
+   */
+  ArrayView<Order> GetTransactions(size_t from, size_t count) const;
+
+  /**
+   * Get the number of transactions processed on behalf of the client.
+   *
+   * @retval
+   *    The length of the transaction history.
+   */
+  size_t GetTransactionCount() const { return transactions_.size(); }
 
   /**
    * Get the client's current cash balance.
@@ -129,36 +544,305 @@ public:
    * @retval
    *    The client's current cash balance.
    */
-  double GetCashBalance() { return cashBalance_; }
+  double GetCashBalance() const { return FromMoney(snapshots_->Cash()); }
+
+  /**
+   * Open a journal file to which every fill is appended, so that the
+   * client's state can be rebuilt after a restart. If the journal already
+   * holds fills, they are replayed first, replacing the client's cash
+   * balance with the one the journal was created with.
+   *
+   * @note
+   *    This must be called before any orders are submitted. Once a journal
+   *    is open, orders that cannot be journaled (because the file cannot be
+   *    grown) are refused.
+   *
+   * @note
+   *    Replaying interns securities in the order they first appear in the
+   *    journal, so SymbolIds from before a restart must not be reused.
+   *
+   * @param[in] path
+   *    Path of the journal file, which is created if it doesn't exist.
+   *
+   * @retval
+   *    True if the journal was opened and replayed, false if the client has
+   *    already processed orders or the file could not be opened.
+   */
+  bool OpenJournal(const std::string &path);
+
+  /**
+   * Open a journal file as for OpenJournal(path), also restoring from and
+   * writing periodic checkpoints of the client's state.
+   *
+   * If the checkpoint directory holds a checkpoint no later than the end of
+   * the journal, the newest one that loads is used and only the fills
+   * journaled after it are replayed, so recovery time is bounded by the
+   * checkpoint interval rather than the age of the account. The in-memory
+   * transaction history then only starts at the checkpoint; earlier fills
+   * remain in the journal.
+   *
+   * The order that completes each interval copies the client's positions and
+   * lots into memory, in time linear in their number, and hands the copy to
+   * a background thread, which writes it to disk. If the disk falls behind,
+   * a checkpoint still waiting to be written is replaced by the next one.
+   * FlushCheckpoints waits for the writes.
+   *
+   * @param[in] path
+   *    Path of the journal file, which is created if it doesn't exist.
+   *
+   * @param[in] checkpointDirectory
+   *    Existing directory in which checkpoints are kept.
+   *
+   * @param[in] checkpointInterval
+   *    Number of fills between checkpoints, or zero to never write them.
+   *    Only the two newest checkpoints are kept.
+   *
+   * @retval
+   *    True if the journal was opened and the client's state restored,
+   *    false if the client has already processed orders or the journal
+   *    could not be opened.
+   */
+  bool OpenJournal(const std::string &path,
+                   const std::string &checkpointDirectory,
+                   uint64_t checkpointInterval);
+
+  /**
+   * Write a checkpoint of the client's cash balance, positions and open
+   * lots, tagged with the current sequence number.
+   *
+   * @param[in] path
+   *    Path of the checkpoint file, which is replaced atomically.
+   *
+   * @retval
+   *    True if the checkpoint was written, false if the file could not be
+   *    written.
+   */
+  bool WriteCheckpoint(const std::string &path) const;
+
+  /**
+   * Wait until every periodic checkpoint taken so far has been written.
+   *
+   * @retval
+   *    True if every periodic checkpoint written since the last call
+   *    succeeded, or if none are being written.
+   */
+  bool FlushCheckpoints();
+
+  /**
+   * Get the number of fills processed over the lifetime of the account,
+   * including any restored from a journal or checkpoint.
+   *
+   * @retval
+   *    The sequence number of the next fill.
+   */
+  uint64_t GetSequenceNumber() const {
+    return sequenceBase_ + transactions_.size();
+  }
+
+  /**
+   * Switch the client into asynchronous cost basis mode. Orders then only
+   * update quantities, cash and the transaction history before returning;
+   * consuming lots and recomputing each position's cost basis is left to a
+   * background thread. Until that catches up, the price reported for a
+   * position may be stale, as shown by its GetCostBasisVersion lagging
+   * behind its GetPositionVersion.
+   *
+   * @note
+   *    This must be called before any orders are submitted, and cannot be
+   *    combined with a journal, since checkpoints need the lots.
+   *
+   * @retval
+   *    True if the mode was enabled, false if the client has already
+   *    processed orders or has a journal open.
+   */
+  bool EnableAsyncCostBasis();
+
+  /**
+   * Wait until the cost basis of every position reflects every fill made so
+   * far. Returns immediately unless in asynchronous cost basis mode.
+   */
+  void Flush();
+
+  /**
+   * Flush the journal to disk, blocking until it has been written.
+   *
+   * @retval
+   *    True if the journal was flushed, or if no journal is open.
+   */
+  bool SyncJournal() { return !journal_ || journal_->Sync(); }
 
 private:
+  /// State of a security under the client's policy.
+  typedef BasicSymbolState<Lots> State;
+
   /// Representation of the current balance of the client's cash holdings.
-  double cashBalance_;
+  Money cashBalance_;
+
+  /// Cumulative realized profit or loss across every security.
+  Money realizedPnL_;
+
+  /**
+   * Copies of every position and the cash balance, published for readers
+   * on other threads after every change, or once per SubmitOrders batch.
+   */
+  std::unique_ptr<PositionSnapshots> snapshots_;
+
+  /// Cache behind GetCachedPositions, built from snapshots_.
+  std::unique_ptr<PositionCache> positionCache_;
 
   /**
-   * Stores the current portfolio managed by the client. Prices in this
-   * portfolio reflect the average purchase price across all buy orders.
+   * Interns security names into SymbolIds. Names are only hashed here, at
+   * the API boundary; all other internal state is keyed by id.
+   */
+  SymbolTable symbols_;
+
+  /**
+   * Stores the current portfolio managed by the client, as one State
+   * record per interned security, indexed by SymbolId. Securities that are
+   * no longer held keep their record, with a quantity of zero.
    *
-   * The portfolio is represented as a map keyed by the security name, which
-   * is assumed to be globally unique across all securities.
+   * Prices derived from this portfolio reflect the average purchase price
+   * across all buy orders, with buy orders removed (when the security is
+   * sold) as the cost basis policy chooses.
+   */
+  std::vector<State, PolyAllocator<State>> portfolio_;
+
+  /**
+   * Quantity held of every security, indexed by SymbolId, kept as a column
+   * of doubles alongside portfolio_ so that Valuate runs over contiguous
+   * arrays of the type it computes in.
+   */
+  std::vector<double, PolyAllocator<double>> quantityColumn_;
+
+  /**
+   * Total cost of every security, indexed by SymbolId, kept alongside
+   * portfolio_ for Valuate. Not maintained in asynchronous cost basis mode.
    */
-  std::map<std::string, SecurityPosition> portfolio_;
+  std::vector<double, PolyAllocator<double>> costColumn_;
+
+  /**
+   * Total cost of every security as last published by the cost basis
+   * worker, gathered by Valuate in asynchronous mode. Kept between calls so
+   * that repricing does not allocate.
+   */
+  mutable std::vector<double, PolyAllocator<double>> publishedCosts_;
+
+  /**
+   * Whether SubmitOrders is running, and so publication is left until the
+   * end of its batch.
+   */
+  bool batching_ = false;
+
+  /// Sequence number at the start of the batch SubmitOrders is running.
+  uint64_t batchStart_ = 0;
+
+  /**
+   * Securities changed by the batch SubmitOrders is running, each noted
+   * once. Kept with room for every security, so noting one never allocates.
+   */
+  std::vector<SymbolId, PolyAllocator<SymbolId>> batchSymbols_;
 
   /**
    * Stores all the processed transactions of securities, in order of
    * processing.
    */
-  std::vector<Order> transactions_;
+  std::vector<Order, PolyAllocator<Order>> transactions_;
+
+  /// Journal to which fills are appended, if one has been opened.
+  std::unique_ptr<TransactionJournal> journal_;
 
   /**
-   * Stores a map of security name to the latest buy orders for that security,
-   * that have not yet had their contents sold. This is necessary for
-   * calculating the weighted average of a security's price after a sale.
+   * Sequence number of the first fill in transactions_, which is non-zero
+   * if the client was restored from a checkpoint.
+   */
+  uint64_t sequenceBase_ = 0;
+
+  /// Directory in which periodic checkpoints are written.
+  std::string checkpointDirectory_;
+
+  /// Number of fills between periodic checkpoints, or zero for none.
+  uint64_t checkpointInterval_ = 0;
+
+  /// Writes periodic checkpoints in the background, if they are enabled.
+  std::unique_ptr<CheckpointWriter> checkpointWriter_;
+
+  /**
+   * Worker maintaining lots and cost basis in asynchronous cost basis mode,
+   * or null if they are maintained inline.
+   */
+  std::unique_ptr<CostBasisWorker<Lots>> costBasis_;
+
+  /**
+   * Publishes a security's position and the cash balance to readers.
+   *
+   * @param[in] symbol
+   *    Id of the security whose position has changed.
+   */
+  void Publish(SymbolId symbol) {
+    const State &state = portfolio_[symbol];
+    snapshots_->Publish(symbol, state.quantity, state.totalCost);
+    snapshots_->PublishCash(cashBalance_);
+    quantityColumn_[symbol] = state.quantity;
+    costColumn_[symbol] = FromMoney(state.totalCost);
+  }
+
+  /**
+   * Publishes a security's position and the cash balance after a fill or,
+   * while SubmitOrders is running, notes the security for publication at
+   * the end of the batch.
+   *
+   * @param[in] symbol
+   *    Id of the security filled.
+   *
+   * @param[in] previousFill
+   *    The security's lastFill from before this fill.
+   */
+  void PublishFill(SymbolId symbol, uint64_t previousFill) {
+    if (!batching_) {
+      Publish(symbol);
+    } else if (previousFill <= batchStart_) {
+      batchSymbols_.push_back(symbol);
+    }
+  }
+
+  /**
+   * Rebuilds the client's state from the fills in the journal, applying
+   * them directly without validation.
    *
-   * Buy orders are inserted and removed (when the security is sold) on a
-   * FIFO basis.
+   * @param[in] from
+   *    Index of the first journal record to apply.
    */
-  std::map<std::string, std::queue<Order>> outstandingBuyOrderMap_;
+  void ReplayJournal(uint64_t from);
+
+  /**
+   * Restores the client's cash balance, positions and open lots from a
+   * checkpoint.
+   *
+   * @param[in] path
+   *    Path of the checkpoint file.
+   *
+   * @retval
+   *    True if the checkpoint was valid and has been loaded.
+   */
+  bool LoadCheckpoint(const std::string &path);
+
+  /**
+   * Lays out a checkpoint of the client's cash balance, positions and open
+   * lots in memory, exactly as it is written to disk.
+   *
+   * @param[out] buffer
+   *    Buffer replaced with the contents of the checkpoint.
+   */
+  void SerializeCheckpoint(std::vector<char> *buffer) const;
+
+  /**
+   * Records a fill that has just been applied, appending it to the journal
+   * and writing a checkpoint if one is due.
+   *
+   * @param[in] order
+   *    The fill, as recorded in the transaction history.
+   */
+  void RecordFill(const Order &order);
 
   /**
    * Handles a buy order, updating internal state (including portfolio
@@ -168,10 +852,16 @@ private:
    *    This method expects that the order has already been validated
    *    (i.e. that it will not overdraw the cash balance).
    *
+   * @param[in] symbol
+   *    Id of the security named in the order.
+   *
    * @param[in] order
    *    New buy order from which to update internal state.
+   *
+   * @param[in] price
+   *    Price of the order, converted to Money.
    */
-  void HandleBuy(Order order);
+  void HandleBuy(SymbolId symbol, const Order &order, Money price);
 
   /**
    * Handles a sell order, updating internal state (including portfolio
@@ -181,8 +871,36 @@ private:
    *    This method expects that the order has already been validated (i.e.
    *    that we will not sell shares that we don't have).
    *
+   * @param[in] symbol
+   *    Id of the security named in the order.
+   *
    * @param[in] order
    *    New sell order from which to update internal state.
+   *
+   * @param[in] price
+   *    Price of the order, converted to Money.
    */
-  void HandleSell(Order order);
+  void HandleSell(SymbolId symbol, const Order &order, Money price);
 };
+
+/// Client using the default, FIFO, cost basis policy.
+typedef BasicBrokerClient<LotQueue> BrokerClient;
+
+/// Client selling the most recently bought shares first.
+typedef BasicBrokerClient<LotStack> LifoBrokerClient;
+
+/// Client selling the most expensive shares first.
+typedef BasicBrokerClient<LotHeap> HifoBrokerClient;
+
+/// Client selling every share at its position's average cost.
+typedef BasicBrokerClient<AverageCost> AverageCostBrokerClient;
+
+// Instantiated once, in BrokerClient.cpp, for each policy.
+extern template struct BasicSymbolState<LotQueue>;
+extern template struct BasicSymbolState<LotStack>;
+extern template struct BasicSymbolState<LotHeap>;
+extern template struct BasicSymbolState<AverageCost>;
+extern template class BasicBrokerClient<LotQueue>;
+extern template class BasicBrokerClient<LotStack>;
+extern template class BasicBrokerClient<LotHeap>;
+extern template class BasicBrokerClient<AverageCost>;
@@ -0,0 +1,612 @@
+/**
+ * @file BrokerClientBench.cpp
+ *
+ * Microbenchmarks for the BrokerClient hot paths. Each benchmark reports
+ * ns/op, ops/sec and p50/p99/p999 latency, and the results are also written
+ * as JSON so that they can be compared between releases.
+ *
+ * Usage: ./bench [--quick] [output.json]
+ */
+
+#include "BrokerClient.hpp"
+#include "BrokerEngine.hpp"
+#include "BrokerExecutor.hpp"
+#include "BrokerManager.hpp"
+#include "ConcurrentBrokerClient.hpp"
+#include "LatencyStats.hpp"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/// Results of every benchmark run so far, in order.
+static std::vector<std::pair<std::string, LatencySummary>> results;
+
+/// Divisor applied to every benchmark's size, set by --quick.
+static size_t scale = 1;
+
+/// Prevents the compiler from optimizing away a benchmark's result.
+static volatile uint64_t sink;
+
+/**
+ * Record and print the summary of a benchmark. A summary with a maximum
+ * latency of zero has no latency samples, and only its throughput is shown.
+ */
+static void Report(const std::string &name, const LatencySummary &summary) {
+  results.push_back(std::make_pair(name, summary));
+  if (summary.maxNs == 0) {
+    printf("%-28s %12.1f ns/op %14.0f ops/s\n", name.c_str(),
+           summary.nsPerOp, summary.opsPerSec);
+    fflush(stdout);
+    return;
+  }
+  printf("%-28s %12.1f ns/op %14.0f ops/s   p50 %8llu  p99 %8llu  "
+         "p999 %8llu ns\n",
+         name.c_str(), summary.nsPerOp, summary.opsPerSec,
+         (unsigned long long)summary.p50Ns, (unsigned long long)summary.p99Ns,
+         (unsigned long long)summary.p999Ns);
+  fflush(stdout);
+}
+
+/**
+ * Run a benchmark of ops operations, twice: once timing the whole loop for
+ * throughput, and once timing each operation for latency. Each pass gets a
+ * fresh fixture.
+ *
+ * @param[in] name
+ *    Name of the benchmark.
+ *
+ * @param[in] ops
+ *    Number of operations to run.
+ *
+ * @param[in] setup
+ *    Callable returning a new fixture, which is not timed.
+ *
+ * @param[in] op
+ *    Callable taking the fixture and the operation's index.
+ */
+template <typename Setup, typename Op>
+static void Run(const std::string &name, size_t ops, Setup setup, Op op) {
+  auto fixture = setup();
+  uint64_t start = NowNs();
+  for (size_t i = 0; i < ops; i++) {
+    op(fixture, i);
+  }
+  uint64_t totalNs = NowNs() - start;
+
+  auto latencyFixture = setup();
+  std::vector<uint64_t> samples(ops);
+  for (size_t i = 0; i < ops; i++) {
+    uint64_t opStart = NowNs();
+    op(latencyFixture, i);
+    samples[i] = NowNs() - opStart;
+  }
+  Report(name, SummarizeLatency(ops, totalNs, samples));
+}
+
+/// Build a client holding the given number of symbols, interned in order.
+static BrokerClient MakeClient(double cash, size_t symbols,
+                               std::vector<SymbolId> &ids) {
+  BrokerClient client = BrokerClient(cash);
+  ids.clear();
+  for (size_t i = 0; i < symbols; i++) {
+    ids.push_back(client.InternSymbol("SYM" + std::to_string(i)));
+  }
+  return client;
+}
+
+/// A stream of buys rotating across 100 symbols, submitted by id.
+static void BenchBuyOnly() {
+  std::vector<SymbolId> ids;
+  Run("buy_only", 1000000 / scale,
+      [&]() { return MakeClient(1e15, 100, ids); },
+      [&](BrokerClient &client, size_t i) {
+        sink += client.SubmitOrder(Buy, ids[i % ids.size()], 10,
+                                   100 + i % 50);
+      });
+}
+
+/// The same stream of buys, submitted by name through the Order interface.
+static void BenchBuyByName() {
+  std::vector<Order> orders;
+  for (size_t i = 0; i < 100; i++) {
+    Order order = {.kind = Buy,
+                   .position = {.name = "SYM" + std::to_string(i),
+                                .quantity = 10,
+                                .price = (double)(100 + i % 50)}};
+    orders.push_back(order);
+  }
+  Run("buy_by_name", 1000000 / scale, [&]() { return BrokerClient(1e15); },
+      [&](BrokerClient &client, size_t i) {
+        sink += client.SubmitOrder(orders[i % orders.size()]);
+      });
+}
+
+/// The same stream of buys, submitted by name in batches of 1000.
+static void BenchBuyBatch() {
+  const size_t batch = 1000;
+  std::vector<Order> orders;
+  for (size_t i = 0; i < batch; i++) {
+    Order order = {.kind = Buy,
+                   .position = {.name = "SYM" + std::to_string(i / 10 % 100),
+                                .quantity = 10,
+                                .price = (double)(100 + i % 50)}};
+    orders.push_back(order);
+  }
+  std::vector<uint32_t> filled(batch);
+
+  /*
+   * Each op is one batch, so the percentiles are of whole batches. Only the
+   * mean can be divided back down to a per-order figure.
+   */
+  Run("buy_batch_1000", 1000 / scale, [&]() { return BrokerClient(1e15); },
+      [&](BrokerClient &client, size_t) {
+        client.SubmitOrders(orders.data(), batch, filled.data());
+        sink += filled[0];
+      });
+  LatencySummary perBatch = results.back().second;
+  LatencySummary perOrder = {.ops = perBatch.ops * batch,
+                             .nsPerOp = perBatch.nsPerOp / batch,
+                             .opsPerSec = perBatch.opsPerSec * batch,
+                             .p50Ns = 0,
+                             .p99Ns = 0,
+                             .p999Ns = 0,
+                             .maxNs = 0};
+  Report("buy_batch_1000_per_order", perOrder);
+}
+
+/**
+ * Sells of 3 shares at a time across many 1-share lots, under a cost basis
+ * policy.
+ *
+ * @param[in] name
+ *    Name of the benchmark.
+ */
+template <typename Client> static void BenchSellSmallLots(const char *name) {
+  const size_t lots = 3000000 / scale;
+  SymbolId symbol = 0;
+  Run(name, lots / 3,
+      [&]() {
+        Client client = Client(1e15);
+        symbol = client.InternSymbol("SYM0");
+        for (size_t i = 0; i < lots; i++) {
+          client.SubmitOrder(Buy, symbol, 1, 100 + i % 50);
+        }
+        return client;
+      },
+      [&](Client &client, size_t) {
+        sink += client.SubmitOrder(Sell, symbol, 3, 120);
+      });
+}
+
+/**
+ * The worst case for HandleSell: liquidating a position built from 100k
+ * 1-share lots in a single order. Only the sell is timed.
+ *
+ * @param[in] async
+ *    Whether to use asynchronous cost basis mode, in which the sell returns
+ *    without consuming the lots.
+ */
+static void BenchSellWorstCase(bool async) {
+  const size_t lots = 100000;
+  const size_t reps = 50 / scale;
+  std::vector<SymbolId> ids;
+  std::vector<uint64_t> samples;
+  uint64_t totalNs = 0;
+  for (size_t rep = 0; rep < reps; rep++) {
+    BrokerClient client = MakeClient(1e15, 1, ids);
+    if (async) {
+      client.EnableAsyncCostBasis();
+    }
+    for (size_t i = 0; i < lots; i++) {
+      client.SubmitOrder(Buy, ids[0], 1, 100 + i % 50);
+    }
+    client.Flush();
+    uint64_t start = NowNs();
+    sink += client.SubmitOrder(Sell, ids[0], lots, 120);
+    uint64_t elapsed = NowNs() - start;
+    samples.push_back(elapsed);
+    totalNs += elapsed;
+  }
+  Report(async ? "sell_worst_case_100k_lots_async"
+               : "sell_worst_case_100k_lots",
+         SummarizeLatency(reps, totalNs, samples));
+}
+
+/// GetPositions on a portfolio of 10k symbols.
+static void BenchGetPositions() {
+  std::vector<SymbolId> ids;
+  Run("get_positions_10k", 2000 / scale,
+      [&]() {
+        BrokerClient client = MakeClient(1e15, 10000, ids);
+        for (SymbolId id : ids) {
+          client.SubmitOrder(Buy, id, 10, 100);
+        }
+        return client;
+      },
+      [&](BrokerClient &client, size_t) {
+        sink += client.GetPositions().size();
+      });
+}
+
+/**
+ * Repricing a portfolio of 10k symbols on a market tick: with Valuate over a
+ * dense price array, and the way it had to be done before, by GetPositions
+ * and a lookup by name per row.
+ */
+static void BenchValuate() {
+  std::vector<SymbolId> ids;
+  BrokerClient client = MakeClient(1e15, 10000, ids);
+  std::vector<double> prices;
+  std::unordered_map<std::string, double> pricesByName;
+  for (SymbolId id : ids) {
+    client.SubmitOrder(Buy, id, 10 + id % 7, 100);
+    prices.push_back(100 + id % 13);
+    pricesByName[client.GetSymbolName(id).ToString()] = prices.back();
+  }
+  std::vector<double> values(ids.size()), unrealized(ids.size()),
+      weights(ids.size());
+
+  Run("valuate_10k", 20000 / scale, [&]() { return 0; },
+      [&](int, size_t) {
+        Valuation total = client.Valuate(prices.data(), values.data(),
+                                         unrealized.data(), weights.data());
+        sink += (uint64_t)total.unrealizedPnL;
+      });
+  Run("valuate_10k_by_positions", 2000 / scale, [&]() { return 0; },
+      [&](int, size_t) {
+        double unrealizedPnL = 0;
+        for (const SecurityPosition &position : client.GetPositions()) {
+          double price = pricesByName[position.name.ToString()];
+          unrealizedPnL += position.quantity * (price - position.price);
+        }
+        sink += (uint64_t)unrealizedPnL;
+      });
+}
+
+/**
+ * GetCachedPositions on a 5k-name portfolio, both when nothing has changed
+ * and when 10 positions have changed since the previous call.
+ */
+static void BenchGetCachedPositions() {
+  std::vector<SymbolId> ids;
+  BrokerClient client = MakeClient(1e15, 5000, ids);
+  for (SymbolId id : ids) {
+    client.SubmitOrder(Buy, id, 10, 100);
+  }
+
+  Run("get_cached_positions_5k", 1000000 / scale, [&]() { return 0; },
+      [&](int, size_t) { sink += client.GetCachedPositions()->size(); });
+  Run("get_cached_positions_5k_10_dirty", 100000 / scale, [&]() { return 0; },
+      [&](int, size_t i) {
+        for (size_t j = 0; j < 10; j++) {
+          client.SubmitOrder(Buy, ids[(i * 10 + j) % ids.size()], 1, 100);
+        }
+        sink += client.GetCachedPositions()->size();
+      });
+}
+
+/**
+ * Short-lived clients, as in a backtest: each op creates a client, trades 10
+ * symbols and destroys it, with its memory from the heap or from an arena
+ * released after every client.
+ */
+static void BenchClientLifecycle(bool arena) {
+  std::vector<std::string> names;
+  for (int i = 0; i < 10; i++) {
+    names.push_back("SYM" + std::to_string(i));
+  }
+  Run(arena ? "client_lifecycle_arena" : "client_lifecycle_heap",
+      20000 / scale,
+      [&]() {
+        return std::unique_ptr<ArenaResource>(arena ? new ArenaResource()
+                                                    : nullptr);
+      },
+      [&](std::unique_ptr<ArenaResource> &resource, size_t) {
+        {
+          BrokerClient client(1e9, resource.get());
+          for (int i = 0; i < 100; i++) {
+            Order order = {.kind = i % 3 == 2 ? Sell : Buy,
+                           .position = {.name = names[i % names.size()],
+                                        .quantity = 10,
+                                        .price = 100}};
+            sink += client.SubmitOrder(order);
+          }
+        }
+        if (resource) {
+          resource->Release();
+        }
+      });
+}
+
+/// Full and ranged GetTransactions on a 10M-entry history.
+static void BenchGetTransactions() {
+  const size_t history = 10000000 / scale;
+  std::vector<SymbolId> ids;
+  BrokerClient client = MakeClient(1e15, 100, ids);
+  for (size_t i = 0; i < history; i++) {
+    client.SubmitOrder(Buy, ids[i % ids.size()], 1, 100);
+  }
+
+  Run("get_transactions_10m", 1000000 / scale, [&]() { return 0; },
+      [&](int, size_t) { sink += client.GetTransactions().size(); });
+  Run("get_transactions_last_10", 1000000 / scale, [&]() { return 0; },
+      [&](int, size_t) {
+        size_t count = client.GetTransactionCount();
+        for (const Order &order : client.GetTransactions(count - 10, 10)) {
+          sink += order.position.quantity;
+        }
+      });
+}
+
+/**
+ * Run a multi-symbol buy/sell flow on several threads at once, each thread
+ * trading its own 16 symbols, and report the aggregate throughput. Each
+ * thread also times every 16th submission, so the latency percentiles are
+ * those of a caller handing over an order, including any wait for room;
+ * for a queued client that is not the time until the order is processed.
+ *
+ * @param[in] name
+ *    Name of the benchmark.
+ *
+ * @param[in] threadCount
+ *    Number of threads to run.
+ *
+ * @param[in] ids
+ *    Ids of at least 16 * threadCount symbols.
+ *
+ * @param[in] submit
+ *    Callable taking the order's kind, symbol and quantity, and submitting
+ *    it to the client under test.
+ *
+ * @param[in] finish
+ *    Callable run once every thread has submitted its orders, which must
+ *    wait for any still in flight to be processed.
+ */
+template <typename Submit, typename Finish>
+static void RunThreaded(const std::string &name, size_t threadCount,
+                        const std::vector<SymbolId> &ids, Submit submit,
+                        Finish finish) {
+  const size_t ops = 1000000 / scale;
+  const size_t sampleEvery = 16;
+  std::vector<std::vector<uint64_t>> threadSamples(threadCount);
+  for (std::vector<uint64_t> &samples : threadSamples) {
+    samples.reserve(ops / threadCount / sampleEvery + 1);
+  }
+
+  std::vector<std::thread> threads;
+  uint64_t start = NowNs();
+  for (size_t t = 0; t < threadCount; t++) {
+    threads.emplace_back([&, t]() {
+      std::vector<uint64_t> &samples = threadSamples[t];
+      for (size_t i = 0; i < ops / threadCount; i++) {
+        SymbolId symbol = ids[t * 16 + i % 16];
+        OrderKind kind = i % 3 == 2 ? Sell : Buy;
+        if (i % sampleEvery != 0) {
+          submit(kind, symbol, 10 + i % 5);
+          continue;
+        }
+        uint64_t opStart = NowNs();
+        submit(kind, symbol, 10 + i % 5);
+        samples.push_back(NowNs() - opStart);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  finish();
+  uint64_t totalNs = NowNs() - start;
+
+  std::vector<uint64_t> samples;
+  for (const std::vector<uint64_t> &part : threadSamples) {
+    samples.insert(samples.end(), part.begin(), part.end());
+  }
+  Report(name, SummarizeLatency(ops, totalNs, samples));
+}
+
+/**
+ * The same multi-symbol flow on 1 to 8 threads, through BrokerClient behind
+ * one global mutex, through ConcurrentBrokerClient, through a BrokerEngine
+ * fed by every thread, and through a BrokerManager and a BrokerExecutor with
+ * a shard or worker per thread, each symbol standing for an account.
+ */
+static void BenchThreadScaling() {
+  for (size_t threadCount = 1; threadCount <= 8; threadCount *= 2) {
+    std::string suffix = "_" + std::to_string(threadCount) + "t";
+
+    std::vector<SymbolId> ids;
+    BrokerClient client = MakeClient(1e15, 16 * threadCount, ids);
+    std::mutex mutex;
+    RunThreaded("global_mutex" + suffix, threadCount, ids,
+                [&](OrderKind kind, SymbolId symbol, uint32_t quantity) {
+                  std::lock_guard<std::mutex> lock(mutex);
+                  sink += client.SubmitOrder(kind, symbol, quantity, 100);
+                },
+                []() {});
+
+    ConcurrentBrokerClient concurrent(1e15);
+    for (size_t i = 0; i < 16 * threadCount; i++) {
+      ids[i] = concurrent.InternSymbol("SYM" + std::to_string(i));
+    }
+    RunThreaded("lock_striped" + suffix, threadCount, ids,
+                [&](OrderKind kind, SymbolId symbol, uint32_t quantity) {
+                  sink += concurrent.SubmitOrder(kind, symbol, quantity, 100);
+                },
+                []() {});
+
+    // The engine's client interns names itself, so ids index the names.
+    std::vector<std::string> names;
+    for (size_t i = 0; i < 16 * threadCount; i++) {
+      names.push_back("SYM" + std::to_string(i));
+      ids[i] = (SymbolId)i;
+    }
+    BrokerEngine engine(1e15);
+    RunThreaded("engine" + suffix, threadCount, ids,
+                [&](OrderKind kind, SymbolId symbol, uint32_t quantity) {
+                  Order order = {.kind = kind,
+                                 .position = {.name = names[symbol],
+                                              .quantity = quantity,
+                                              .price = 100}};
+                  while (!engine.TrySubmit(order, FillCallback())) {
+                    std::this_thread::yield();
+                  }
+                },
+                [&]() { engine.Stop(); });
+
+    // Each id names an account on a manager with a shard per thread.
+    BrokerManager manager(threadCount);
+    for (size_t i = 0; i < 16 * threadCount; i++) {
+      manager.OpenAccount(i, 1e15);
+    }
+    RunThreaded("manager" + suffix, threadCount, ids,
+                [&](OrderKind kind, SymbolId account, uint32_t quantity) {
+                  Order order = {
+                      .kind = kind,
+                      .position = {.name = "SYM", .quantity = quantity,
+                                   .price = 100}};
+                  while (!manager.TrySubmit(account, order, FillCallback())) {
+                    std::this_thread::yield();
+                  }
+                },
+                [&]() { manager.Stop(); });
+
+    BrokerExecutor executor(threadCount);
+    for (size_t i = 0; i < 16 * threadCount; i++) {
+      executor.OpenAccount(i, 1e15);
+    }
+    RunThreaded("executor" + suffix, threadCount, ids,
+                [&](OrderKind kind, SymbolId account, uint32_t quantity) {
+                  Order order = {
+                      .kind = kind,
+                      .position = {.name = "SYM", .quantity = quantity,
+                                   .price = 100}};
+                  while (!executor.TrySubmit(account, order, FillCallback())) {
+                    std::this_thread::yield();
+                  }
+                },
+                [&]() { executor.Stop(); });
+  }
+}
+
+/**
+ * A bursty flow on 4 threads, in which half of every thread's orders go to
+ * one account, through a BrokerManager, which leaves the other accounts on
+ * that account's shard waiting behind it, and through a BrokerExecutor,
+ * whose idle workers steal them.
+ */
+static void BenchBurstyAccounts() {
+  const size_t threadCount = 4;
+  std::vector<SymbolId> ids(16 * threadCount);
+  for (size_t i = 0; i < ids.size(); i++) {
+    ids[i] = i % 16 < 8 ? 0 : (SymbolId)i;
+  }
+  auto orderFor = [](OrderKind kind, uint32_t quantity) {
+    Order order = {.kind = kind,
+                   .position = {.name = "SYM", .quantity = quantity,
+                                .price = 100}};
+    return order;
+  };
+
+  BrokerManager manager(threadCount);
+  for (size_t i = 0; i < ids.size(); i++) {
+    manager.OpenAccount(i, 1e15);
+  }
+  RunThreaded("bursty_manager_4t", threadCount, ids,
+              [&](OrderKind kind, SymbolId account, uint32_t quantity) {
+                while (!manager.TrySubmit(account, orderFor(kind, quantity),
+                                          FillCallback())) {
+                  std::this_thread::yield();
+                }
+              },
+              [&]() { manager.Stop(); });
+
+  BrokerExecutor executor(threadCount);
+  for (size_t i = 0; i < ids.size(); i++) {
+    executor.OpenAccount(i, 1e15);
+  }
+  RunThreaded("bursty_executor_4t", threadCount, ids,
+              [&](OrderKind kind, SymbolId account, uint32_t quantity) {
+                while (!executor.TrySubmit(account, orderFor(kind, quantity),
+                                           FillCallback())) {
+                  std::this_thread::yield();
+                }
+              },
+              [&]() { executor.Stop(); });
+}
+
+/// Write every benchmark's results to a JSON file.
+static bool WriteJson(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == nullptr) {
+    return false;
+  }
+  fprintf(file, "{\n  \"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const LatencySummary &summary = results[i].second;
+    if (summary.maxNs == 0) {
+      fprintf(file,
+              "    {\"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.2f, "
+              "\"ops_per_sec\": %.2f}%s\n",
+              results[i].first.c_str(), (unsigned long long)summary.ops,
+              summary.nsPerOp, summary.opsPerSec,
+              i + 1 < results.size() ? "," : "");
+      continue;
+    }
+    fprintf(file,
+            "    {\"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.2f, "
+            "\"ops_per_sec\": %.2f, \"p50_ns\": %llu, \"p99_ns\": %llu, "
+            "\"p999_ns\": %llu, \"max_ns\": %llu}%s\n",
+            results[i].first.c_str(), (unsigned long long)summary.ops,
+            summary.nsPerOp, summary.opsPerSec,
+            (unsigned long long)summary.p50Ns,
+            (unsigned long long)summary.p99Ns,
+            (unsigned long long)summary.p999Ns,
+            (unsigned long long)summary.maxNs,
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  return fclose(file) == 0;
+}
+
+int main(int argc, char **argv) {
+  const char *output = "bench.json";
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      scale = 10;
+    } else {
+      output = argv[i];
+    }
+  }
+
+  std::cout << "Running BrokerClientBench" << std::endl;
+  BenchBuyOnly();
+  BenchBuyByName();
+  BenchBuyBatch();
+  BenchSellSmallLots<BrokerClient>("fifo_sell_small_lots");
+  BenchSellSmallLots<LifoBrokerClient>("lifo_sell_small_lots");
+  BenchSellSmallLots<HifoBrokerClient>("hifo_sell_small_lots");
+  BenchSellSmallLots<AverageCostBrokerClient>("average_sell_small_lots");
+  BenchSellWorstCase(false);
+  BenchSellWorstCase(true);
+  BenchGetPositions();
+  BenchValuate();
+  BenchGetCachedPositions();
+  BenchGetTransactions();
+  BenchClientLifecycle(false);
+  BenchClientLifecycle(true);
+  BenchThreadScaling();
+  BenchBurstyAccounts();
+
+  if (!WriteJson(output)) {
+    std::cerr << "Failed to write results to " << output << std::endl;
+    return 1;
+  }
+  std::cout << "Results written to " << output << std::endl;
+  return 0;
+}
@@ -1,5 +1,25 @@
 #include "BrokerClient.hpp"
+#include "Checkpoint.hpp"
+#include "BrokerEngine.hpp"
+#include "BrokerExecutor.hpp"
+#include "BrokerManager.hpp"
+#include "ChunkedArray.hpp"
+#include "ConcurrentBrokerClient.hpp"
+#include "OrderStream.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <fstream>
 #include <iostream>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
 
 /// Helper function for checking position equality.
 static bool positionsEqual(SecurityPosition a, SecurityPosition b) {
@@ -164,6 +184,1807 @@ void testSellNone() {
   assert(client.GetTransactions().empty());
 }
 
+/// Check the id-based overload behaves like the name-based one.
+void testSubmitBySymbolId() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  uint32_t transacted;
+  BrokerClient client = BrokerClient(10000);
+  SymbolId aapl = client.InternSymbol("AAPL");
+  SymbolId msft = client.InternSymbol("MSFT");
+  assert(aapl != msft);
+  SymbolId again = client.InternSymbol("AAPL");
+  assert(again == aapl);
+  (void)again;
+  assert(client.GetSymbolName(msft) == "MSFT");
+
+  transacted = client.SubmitOrder(Buy, aapl, 10, 100);
+  assert(transacted == 10);
+  Order sellOrder = {
+      .kind = Sell,
+      .position = {.name = std::string("AAPL"), .quantity = 4, .price = 150}};
+  transacted = client.SubmitOrder(sellOrder);
+  assert(transacted == 4);
+  transacted = client.SubmitOrder(Sell, msft, 10, 100);
+  assert(transacted == 0);
+  assert(client.GetCashBalance() == 9600);
+
+  std::vector<SecurityPosition> portfolio = client.GetPositions();
+  assert(portfolio.size() == 1);
+  assert(portfolio[0].name == "AAPL");
+  assert(portfolio[0].quantity == 6);
+  assert(portfolio[0].price == 100);
+
+  Order expectedOrder = {
+      .kind = Buy,
+      .position = {.name = std::string("AAPL"), .quantity = 10, .price = 100}};
+  std::vector<Order> orders = client.GetTransactions();
+  assert(orders.size() == 2);
+  assert(ordersEqual(orders[0], expectedOrder));
+  (void)transacted;
+}
+
+/// Check positions are tracked independently across several securities.
+void testMultipleSymbols() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  uint32_t transacted;
+  BrokerClient client = BrokerClient(10000);
+  SymbolId aapl = client.InternSymbol("AAPL");
+  SymbolId msft = client.InternSymbol("MSFT");
+  SymbolId goog = client.InternSymbol("GOOG");
+
+  transacted = client.SubmitOrder(Buy, aapl, 10, 100);
+  assert(transacted == 10);
+  transacted = client.SubmitOrder(Buy, msft, 20, 50);
+  assert(transacted == 20);
+  transacted = client.SubmitOrder(Buy, goog, 5, 200);
+  assert(transacted == 5);
+  transacted = client.SubmitOrder(Sell, msft, 20, 60);
+  assert(transacted == 20);
+
+  std::vector<SecurityPosition> portfolio = client.GetPositions();
+  assert(portfolio.size() == 2);
+  assert(portfolio[0].name == "AAPL" && portfolio[0].quantity == 10);
+  assert(portfolio[1].name == "GOOG" && portfolio[1].quantity == 5);
+
+  // Buying back a security we sold out of starts a fresh cost basis.
+  transacted = client.SubmitOrder(Buy, msft, 10, 70);
+  assert(transacted == 10);
+  portfolio = client.GetPositions();
+  assert(portfolio.size() == 3);
+  assert(portfolio[1].name == "MSFT");
+  assert(portfolio[1].quantity == 10 && portfolio[1].price == 70);
+  assert(client.GetCashBalance() == 10000 - 1000 - 1000 - 1000 + 1200 - 700);
+  (void)transacted;
+}
+
+/// Check FIFO lot consumption across many lots, including ring wraparound.
+void testSellAcrossManyLots() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  uint32_t transacted;
+  BrokerClient client = BrokerClient(10000);
+  SymbolId spy = client.InternSymbol("SPY");
+  std::vector<SecurityPosition> portfolio;
+
+  for (uint32_t price = 1; price <= 10; price++) {
+    transacted = client.SubmitOrder(Buy, spy, 2, price);
+    assert(transacted == 2);
+  }
+
+  // Consume the first two lots and half of the third.
+  transacted = client.SubmitOrder(Sell, spy, 5, 1);
+  assert(transacted == 5);
+  portfolio = client.GetPositions();
+  assert(portfolio[0].quantity == 15);
+  assert(portfolio[0].price == (3.0 + 2 * (4 + 5 + 6 + 7 + 8 + 9 + 10)) / 15);
+
+  // Push enough lots that the ring buffer wraps.
+  for (uint32_t i = 0; i < 8; i++) {
+    transacted = client.SubmitOrder(Buy, spy, 2, 20);
+    assert(transacted == 2);
+  }
+  transacted = client.SubmitOrder(Sell, spy, 17, 1);
+  assert(transacted == 17);
+  portfolio = client.GetPositions();
+  assert(portfolio[0].quantity == 14);
+  assert(portfolio[0].price == 20);
+  (void)transacted;
+}
+
+/// Check a position that is never sold out keeps an accurate cost basis.
+void testLongHeldPosition() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  uint32_t transacted;
+  BrokerClient client = BrokerClient(1e9);
+  SymbolId spy = client.InternSymbol("SPY");
+
+  /*
+   * Keep turning over a position while always holding some of it, so the
+   * lots' running totals would keep growing unless rebased.
+   */
+  transacted = client.SubmitOrder(Buy, spy, 1, 10);
+  assert(transacted == 1);
+  for (uint32_t i = 0; i < 200000; i++) {
+    transacted = client.SubmitOrder(Buy, spy, 1000, 123.4567);
+    assert(transacted == 1000);
+    transacted = client.SubmitOrder(Sell, spy, 1000, 130);
+    assert(transacted == 1000);
+  }
+  SecurityPosition position = client.GetPosition(spy);
+  assert(position.quantity == 1);
+  assert(std::fabs(position.price - 123.4567) < 1e-9);
+  (void)transacted;
+  (void)position;
+}
+
+/// Check large sales spanning many micro-lots consume the right cost basis.
+void testLiquidateManyMicroLots() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  uint32_t transacted;
+  BrokerClient client = BrokerClient(1000000);
+  SymbolId spy = client.InternSymbol("SPY");
+  std::vector<SecurityPosition> portfolio;
+
+  // Lots alternate between 1 and 2 shares, at prices cycling from 1 to 4.
+  const uint32_t lots = 100000;
+  uint32_t totalQuantity = 0;
+  for (uint32_t i = 0; i < lots; i++) {
+    totalQuantity += client.SubmitOrder(Buy, spy, 1 + i % 2, 1 + i % 4);
+  }
+  assert(totalQuantity == 150000);
+
+  // Sell the first 1000 lots (1500 shares) plus one share of the next.
+  transacted = client.SubmitOrder(Sell, spy, 1501, 1);
+  assert(transacted == 1501);
+  portfolio = client.GetPositions();
+  assert(portfolio[0].quantity == 148499);
+  double remainingCost = 0;
+  for (uint32_t i = 1000; i < lots; i++) {
+    remainingCost += (1 + i % 2) * (1 + i % 4);
+  }
+  assert(std::fabs(portfolio[0].price - (remainingCost - 1) / 148499) < 1e-9);
+
+  // Liquidate everything that's left in a single order.
+  transacted = client.SubmitOrder(Sell, spy, totalQuantity, 10);
+  assert(transacted == 148499);
+  assert(client.GetPositions().empty());
+
+  transacted = client.SubmitOrder(Buy, spy, 3, 5);
+  assert(transacted == 3);
+  portfolio = client.GetPositions();
+  assert(portfolio[0].quantity == 3 && portfolio[0].price == 5);
+  (void)transacted;
+}
+
+/// Check a batch gives the same results as submitting orders one at a time.
+void testSubmitOrdersBatch() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  const char *names[] = {"AAPL", "MSFT", "GOOG"};
+  std::vector<Order> orders;
+  for (uint32_t i = 0; i < 300; i++) {
+    Order order = {
+        .kind = (i % 3 == 2) ? Sell : Buy,
+        .position = {.name = std::string(names[(i / 4) % 3]),
+                     .quantity = 1 + i % 7,
+                     .price = (double)(10 + i % 13)}};
+    orders.push_back(order);
+  }
+
+  BrokerClient single = BrokerClient(5000);
+  BrokerClient batched = BrokerClient(5000);
+
+  // Positions are published once per batch, so check after each of two.
+  for (uint32_t round = 0; round < 2; round++) {
+    std::vector<uint32_t> expected;
+    for (const Order &order : orders) {
+      expected.push_back(single.SubmitOrder(order));
+    }
+    std::vector<uint32_t> filled(orders.size());
+    batched.SubmitOrders(orders.data(), orders.size(), filled.data());
+
+    assert(filled == expected);
+    assert(batched.GetCashBalance() == single.GetCashBalance());
+    std::vector<SecurityPosition> a = single.GetPositions();
+    std::vector<SecurityPosition> b = batched.GetPositions();
+    assert(a.size() == b.size());
+    for (size_t i = 0; i < a.size(); i++) {
+      assert(positionsEqual(a[i], b[i]));
+    }
+    std::shared_ptr<const std::vector<SecurityPosition>> cached =
+        batched.GetCachedPositions();
+    assert(cached->size() == a.size());
+    for (size_t i = 0; i < a.size(); i++) {
+      assert(positionsEqual((*cached)[i], a[i]));
+    }
+  }
+  std::vector<Order> x = single.GetTransactions();
+  std::vector<Order> y = batched.GetTransactions();
+  assert(x.size() == y.size());
+  for (size_t i = 0; i < x.size(); i++) {
+    assert(ordersEqual(x[i], y[i]));
+  }
+}
+
+/// Check ranged access into the transaction history.
+void testTransactionRange() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  BrokerClient client = BrokerClient(10000);
+  SymbolId aapl = client.InternSymbol("AAPL");
+  for (uint32_t quantity = 1; quantity <= 10; quantity++) {
+    client.SubmitOrder(Buy, aapl, quantity, 10);
+  }
+  assert(client.GetTransactionCount() == 10);
+
+  ArrayView<Order> all = client.GetTransactions();
+  assert(all.size() == 10);
+  assert(all[9].position.quantity == 10);
+
+  // The last few fills, as a poller would fetch them.
+  ArrayView<Order> tail = client.GetTransactions(7, 100);
+  assert(tail.size() == 3);
+  uint32_t quantity = 8;
+  for (const Order &order : tail) {
+    assert(order.position.name == "AAPL");
+    assert(order.position.quantity == quantity);
+    quantity++;
+  }
+
+  assert(client.GetTransactions(2, 1).size() == 1);
+  assert(client.GetTransactions(2, 1)[0].position.quantity == 3);
+  assert(client.GetTransactions(10, 5).empty());
+  assert(client.GetTransactions(50, 5).empty());
+}
+
+/// Check cash and cost basis stay exact over many fractional-price trades.
+void testFractionalPrices() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  uint32_t transacted;
+  BrokerClient client = BrokerClient(10000);
+  SymbolId f = client.InternSymbol("F");
+  for (uint32_t i = 0; i < 1000; i++) {
+    transacted = client.SubmitOrder(Buy, f, 1, 0.1);
+    assert(transacted == 1);
+  }
+  transacted = client.SubmitOrder(Sell, f, 500, 0.3);
+  assert(transacted == 500);
+  assert(std::fabs(client.GetPositions()[0].price - 0.1) < 1e-9);
+
+#ifdef BROKER_FIXED_POINT
+  // With integer ticks there is no rounding error to accumulate.
+  assert(client.GetCashBalance() == 10000 - 100 + 150);
+  assert(client.GetPositions()[0].price == 0.1);
+
+  // Prices are rounded to the nearest tick.
+  transacted = client.SubmitOrder(Buy, f, 1, 0.123456);
+  assert(transacted == 1);
+  assert(client.GetTransactions()[1001].position.price == 0.1235);
+#else
+  assert(std::fabs(client.GetCashBalance() - (10000 - 100 + 150)) < 1e-9);
+#endif
+  (void)transacted;
+}
+
+/// Check looking up a single position, including after selling out of it.
+void testGetPosition() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  BrokerClient client = BrokerClient(10000);
+  SymbolId aapl = client.InternSymbol("AAPL");
+  assert(client.GetPosition(aapl).quantity == 0);
+  assert(client.GetPosition("MSFT").quantity == 0);
+  assert(client.GetPosition("MSFT").name == "MSFT");
+
+  client.SubmitOrder(Buy, aapl, 3, 10);
+  client.SubmitOrder(Buy, aapl, 1, 30);
+  SecurityPosition position = client.GetPosition("AAPL");
+  assert(position.name == "AAPL");
+  assert(position.quantity == 4 && position.price == 15);
+
+  client.SubmitOrder(Sell, aapl, 4, 20);
+  position = client.GetPosition(aapl);
+  assert(position.quantity == 0 && position.price == 0);
+  assert(client.GetPositions().empty());
+}
+
+/// Check a client rebuilt from its journal matches the original.
+void testJournalReplay() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  bool ok;
+  std::string path =
+      "/tmp/BrokerClientTests_journal_" + std::to_string(getpid());
+  unlink(path.c_str());
+
+  std::vector<Order> expectedOrders;
+  std::vector<SecurityPosition> expectedPositions;
+  double expectedCash;
+  {
+    BrokerClient client = BrokerClient(10000);
+    ok = client.OpenJournal(path);
+    assert(ok);
+    SymbolId aapl = client.InternSymbol("AAPL");
+    SymbolId msft = client.InternSymbol("MSFT");
+    SymbolId tooLong = client.InternSymbol("A_VERY_LONG_TICKER_NAME");
+    assert(tooLong == InvalidSymbolId);
+    (void)tooLong;
+
+    for (uint32_t i = 0; i < 100000; i++) {
+      client.SubmitOrder(Buy, i % 2 ? aapl : msft, 1 + i % 3, 0.01);
+    }
+    client.SubmitOrder(Sell, aapl, 25000, 0.02);
+    client.SubmitOrder(Buy, msft, 1000000, 50);
+    ok = client.SyncJournal();
+    assert(ok);
+
+    expectedOrders = client.GetTransactions();
+    expectedPositions = client.GetPositions();
+    expectedCash = client.GetCashBalance();
+  }
+
+  BrokerClient restored = BrokerClient(0);
+  ok = restored.OpenJournal(path);
+  assert(ok);
+  assert(restored.GetCashBalance() == expectedCash);
+  // Symbols may be interned in a different order, so compare by name.
+  assert(restored.GetPositions().size() == expectedPositions.size());
+  for (const SecurityPosition &position : expectedPositions) {
+    assert(positionsEqual(restored.GetPosition(position.name), position));
+  }
+  ArrayView<Order> orders = restored.GetTransactions();
+  assert(orders.size() == expectedOrders.size());
+  for (size_t i = 0; i < orders.size(); i++) {
+    assert(ordersEqual(orders[i], expectedOrders[i]));
+  }
+
+  // A journal can't be attached once orders have been processed.
+  ok = restored.OpenJournal(path);
+  assert(!ok);
+  BrokerClient busy = BrokerClient(100);
+  busy.SubmitOrder(Buy, busy.InternSymbol("AAPL"), 1, 1);
+  ok = busy.OpenJournal(path + "_busy");
+  assert(!ok);
+
+  unlink(path.c_str());
+  (void)ok;
+}
+
+/// Check recovery from a checkpoint plus the journal tail after it.
+void testCheckpointRecovery() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  bool ok;
+  char directory[] = "/tmp/BrokerClientTests_checkpoints_XXXXXX";
+  char *created = mkdtemp(directory);
+  assert(created != nullptr);
+  (void)created;
+  std::string journalPath = std::string(directory) + "/journal";
+  const char *names[] = {"AAPL", "MSFT", "GOOG", "AMZN"};
+
+  BrokerClient original = BrokerClient(1000000);
+  ok = original.OpenJournal(journalPath, directory, 1000);
+  assert(ok);
+  for (uint32_t i = 0; i < 5500; i++) {
+    Order order = {.kind = (i % 5 == 4) ? Sell : Buy,
+                   .position = {.name = std::string(names[i % 4]),
+                                .quantity = 1 + i % 13,
+                                .price = (double)(20 + i % 17)}};
+    original.SubmitOrder(order);
+  }
+  uint64_t sequence = original.GetSequenceNumber();
+  assert(sequence == original.GetTransactionCount());
+  assert(sequence > 5000);
+  bool flushed = original.FlushCheckpoints();
+  assert(flushed);
+  (void)flushed;
+
+  /*
+   * Only the two newest checkpoints written are kept. That's normally 4000
+   * and 5000, but a slow disk may have skipped 4000.
+   */
+  uint64_t latest;
+  assert(FindLatestCheckpoint(directory, sequence, &latest));
+  assert(latest == 5000);
+  std::vector<uint64_t> checkpoints;
+  ok = ListCheckpoints(directory, &checkpoints);
+  assert(ok && checkpoints.size() == 2 && checkpoints[1] == 5000);
+
+  // Recovery loads the newest checkpoint and replays only the tail.
+  BrokerClient restored = BrokerClient(0);
+  ok = restored.OpenJournal(journalPath, directory, 1000);
+  assert(ok);
+  assert(restored.GetSequenceNumber() == sequence);
+  assert(restored.GetTransactionCount() == sequence - 5000);
+  assert(restored.GetCashBalance() == original.GetCashBalance());
+  assert(restored.GetPositions().size() == original.GetPositions().size());
+  for (const SecurityPosition &position : original.GetPositions()) {
+    assert(positionsEqual(restored.GetPosition(position.name), position));
+  }
+
+  // Both clients carry on identically, including selling restored lots.
+  for (const char *name : names) {
+    Order order = {.kind = Sell,
+                   .position = {.name = std::string(name),
+                                .quantity = 50,
+                                .price = 40}};
+    uint32_t expected = original.SubmitOrder(order);
+    uint32_t transacted = restored.SubmitOrder(order);
+    assert(transacted == expected);
+    (void)expected;
+    (void)transacted;
+    assert(positionsEqual(restored.GetPosition(name),
+                          original.GetPosition(name)));
+  }
+
+  /*
+   * Checkpoints handed over faster than they can be written replace each
+   * other rather than queueing, and the newest is always written.
+   */
+  {
+    CheckpointWriter writer;
+    for (uint64_t checkpoint = 6000; checkpoint <= 50000; checkpoint += 1000) {
+      std::vector<char> contents(1 << 20, (char)(checkpoint / 1000));
+      writer.Write(directory, checkpoint, contents);
+    }
+    bool written = writer.Flush();
+    assert(written);
+    (void)written;
+  }
+  ok = ListCheckpoints(directory, &checkpoints);
+  assert(ok && !checkpoints.empty() && checkpoints.size() <= 2);
+  assert(checkpoints.back() == 50000);
+
+  for (uint64_t checkpoint : checkpoints) {
+    unlink(CheckpointPath(directory, checkpoint).c_str());
+  }
+  unlink(journalPath.c_str());
+  rmdir(directory);
+  (void)ok;
+}
+
+/**
+ * Overwrite a 64-bit field of a file in place.
+ *
+ * @param[in] path
+ *    Path of the file.
+ *
+ * @param[in] offset
+ *    Offset of the field in the file.
+ *
+ * @param[in] value
+ *    Value to write.
+ */
+static void patchFile(const std::string &path, size_t offset, uint64_t value) {
+  int fd = open(path.c_str(), O_WRONLY);
+  assert(fd >= 0);
+  ssize_t written = pwrite(fd, &value, sizeof(value), offset);
+  assert(written == sizeof(value));
+  (void)written;
+  close(fd);
+}
+
+void testCorruptCheckpoint() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  char directory[] = "/tmp/BrokerClientTests_corrupt_XXXXXX";
+  char *created = mkdtemp(directory);
+  assert(created != nullptr);
+  (void)created;
+  std::string journalPath = std::string(directory) + "/journal";
+
+  // Journal some fills, with two checkpoints part of the way through.
+  BrokerClient original = BrokerClient(1000000);
+  bool opened = original.OpenJournal(journalPath, directory, 0);
+  assert(opened);
+  std::string older;
+  std::string checkpoint;
+  uint64_t olderSequence = 0;
+  for (uint32_t i = 0; i < 300; i++) {
+    if (i == 100 || i == 200) {
+      older = checkpoint;
+      checkpoint = CheckpointPath(directory, original.GetSequenceNumber());
+      if (i == 100) {
+        olderSequence = original.GetSequenceNumber();
+      }
+      bool written = original.WriteCheckpoint(checkpoint);
+      assert(written);
+      (void)written;
+    }
+    std::string name = "SYM" + std::to_string(i % 3);
+    original.SubmitOrder(i % 4 == 3 ? Sell : Buy,
+                         original.InternSymbol(name), 1 + i % 5, 10 + i % 7);
+  }
+  uint64_t sequence = original.GetSequenceNumber();
+
+  // The intact checkpoint is used.
+  {
+    BrokerClient restored = BrokerClient(0);
+    opened = restored.OpenJournal(journalPath, directory, 0);
+    assert(opened);
+    assert(restored.GetTransactionCount() < sequence);
+  }
+
+  /*
+   * A security whose lots run past the end of the lot array, and a symbol
+   * count that overflows back to the file's length, are both rejected. The
+   * older checkpoint is used instead, or if it's corrupt too, the whole
+   * journal is replayed.
+   */
+  uint64_t symbols = original.GetSymbolCount();
+  uint64_t corruptions[][3] = {
+      {sizeof(CheckpointHeader) + offsetof(CheckpointSymbol, firstLot),
+       1ULL << 40, 0},
+      {offsetof(CheckpointHeader, symbolCount), symbols + (1ULL << 60),
+       symbols}};
+  for (const uint64_t *corruption : corruptions) {
+    for (const std::string &corrupt : {checkpoint, older}) {
+      patchFile(corrupt, corruption[0], corruption[1]);
+
+      BrokerClient restored = BrokerClient(0);
+      opened = restored.OpenJournal(journalPath, directory, 0);
+      assert(opened);
+      uint64_t replayed = corrupt == older ? sequence
+                                           : sequence - olderSequence;
+      assert(restored.GetTransactionCount() == replayed);
+      assert(restored.GetCashBalance() == original.GetCashBalance());
+      for (const SecurityPosition &position : original.GetPositions()) {
+        assert(positionsEqual(restored.GetPosition(position.name), position));
+      }
+      (void)replayed;
+    }
+    patchFile(checkpoint, corruption[0], corruption[2]);
+    patchFile(older, corruption[0], corruption[2]);
+  }
+
+  unlink(older.c_str());
+  unlink(checkpoint.c_str());
+  unlink(journalPath.c_str());
+  rmdir(directory);
+}
+
+/// Check indexing lands on distinct, stable elements across chunk boundaries.
+void testChunkedArray() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  typedef ChunkedArray<uint64_t> Array;
+  Array array;
+  bool grown = array.Grow(1);
+  assert(grown);
+  uint64_t *first = &array[0];
+
+  // Fill ten chunks' worth, growing one element at a time.
+  const size_t size = Array::FirstChunkSize * ((1 << 10) - 1);
+  for (size_t i = 0; i < size; i++) {
+    grown = array.Grow(i + 1);
+    assert(grown);
+    array[i] = i;
+  }
+  for (size_t i = 0; i < size; i++) {
+    assert(array[i] == i);
+  }
+
+  // Neighbours either side of each boundary are adjacent within a chunk.
+  for (size_t chunk = 1; chunk < 10; chunk++) {
+    size_t boundary = Array::FirstChunkSize * (((size_t)1 << chunk) - 1);
+    assert(&array[boundary - 2] + 1 == &array[boundary - 1]);
+    assert(&array[boundary] + 1 == &array[boundary + 1]);
+  }
+
+  // Growing never moves elements, and stops at MaxSize.
+  grown = array.Grow(4 * size);
+  assert(grown && &array[0] == first && array[size - 1] == size - 1);
+  grown = array.Grow(Array::MaxSize + 1);
+  assert(!grown);
+  (void)first;
+  (void)grown;
+}
+
+/// Check the concurrent client behaves exactly like BrokerClient on one thread.
+void testConcurrentMatchesSequential() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  BrokerClient client = BrokerClient(50000);
+  ConcurrentBrokerClient concurrent(50000);
+  const char *names[] = {"AAPL", "MSFT", "GOOG"};
+  for (uint32_t i = 0; i < 3000; i++) {
+    Order order = {.kind = (i % 3 == 2) ? Sell : Buy,
+                   .position = {.name = std::string(names[i % 3]),
+                                .quantity = 1 + i % 7,
+                                .price = 10 + i % 11 + 0.25}};
+    uint32_t expected = client.SubmitOrder(order);
+    uint32_t transacted = concurrent.SubmitOrder(order);
+    assert(transacted == expected);
+    (void)expected;
+    (void)transacted;
+  }
+
+  assert(concurrent.GetCashBalance() == client.GetCashBalance());
+  std::vector<SecurityPosition> positions = client.GetPositions();
+  std::vector<SecurityPosition> concurrentPositions =
+      concurrent.GetPositions();
+  assert(concurrentPositions.size() == positions.size());
+  for (size_t i = 0; i < positions.size(); i++) {
+    assert(positionsEqual(concurrentPositions[i], positions[i]));
+  }
+
+  std::vector<Order> transactions = client.GetTransactions();
+  std::vector<Order> concurrentTransactions = concurrent.GetTransactions();
+  assert(concurrent.GetTransactionCount() == transactions.size());
+  assert(concurrentTransactions.size() == transactions.size());
+  for (size_t i = 0; i < transactions.size(); i++) {
+    assert(ordersEqual(concurrentTransactions[i], transactions[i]));
+  }
+}
+
+/**
+ * Hammer the concurrent client from several threads at once, with more buys
+ * than the cash can cover, and check the final state adds up.
+ */
+void testConcurrentOrders() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  const double initialCash = 200000;
+  const uint32_t threadCount = 8;
+  const uint32_t symbolCount = 12;
+  ConcurrentBrokerClient client(initialCash);
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < threadCount; t++) {
+    threads.emplace_back([&client, t]() {
+      for (uint32_t i = 0; i < 5000; i++) {
+        std::string name = "SYM" + std::to_string((t + i) % symbolCount);
+        Order order = {.kind = (i % 4 == 3) ? Sell : Buy,
+                       .position = {.name = name,
+                                    .quantity = 1 + (t + i) % 9,
+                                    .price = (double)(5 + i % 20)}};
+        client.SubmitOrder(order);
+        assert(client.GetCashBalance() >= 0);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  // The history must account for every share and every dollar.
+  double cash = initialCash;
+  std::vector<uint32_t> quantities(symbolCount);
+  std::vector<Order> transactions = client.GetTransactions();
+  assert(transactions.size() == client.GetTransactionCount());
+  for (const Order &order : transactions) {
+    SymbolId symbol = client.InternSymbol(order.position.name);
+    double value = order.position.quantity * order.position.price;
+    if (order.kind == Buy) {
+      quantities[symbol] += order.position.quantity;
+      cash -= value;
+    } else {
+      assert(quantities[symbol] >= order.position.quantity);
+      quantities[symbol] -= order.position.quantity;
+      cash += value;
+    }
+    assert(cash >= 0);
+  }
+  assert(cash == client.GetCashBalance());
+  for (SymbolId symbol = 0; symbol < symbolCount; symbol++) {
+    assert(client.GetPosition(symbol).quantity == quantities[symbol]);
+  }
+}
+
+/// Check orders submitted through the engine match a plain client's.
+void testEngineFutures() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  BrokerClient client = BrokerClient(20000);
+  BrokerEngine engine(20000, 64);
+  const char *names[] = {"AAPL", "MSFT"};
+
+  // More orders than the queue holds, so submission has to wait for room.
+  std::vector<std::future<uint32_t>> futures;
+  std::vector<uint32_t> expected;
+  for (uint32_t i = 0; i < 1000; i++) {
+    Order order = {.kind = (i % 3 == 2) ? Sell : Buy,
+                   .position = {.name = std::string(names[i % 2]),
+                                .quantity = 1 + i % 5,
+                                .price = (double)(10 + i % 7)}};
+    futures.push_back(engine.Submit(order));
+    expected.push_back(client.SubmitOrder(order));
+  }
+  for (size_t i = 0; i < futures.size(); i++) {
+    assert(futures[i].get() == expected[i]);
+  }
+
+  engine.Stop();
+  assert(engine.Client().GetCashBalance() == client.GetCashBalance());
+  assert(engine.Client().GetTransactionCount() ==
+         client.GetTransactionCount());
+  for (const char *name : names) {
+    assert(positionsEqual(engine.Client().GetPosition(name),
+                          client.GetPosition(name)));
+  }
+
+  // Once stopped, no more orders are accepted.
+  Order order = {.kind = Buy,
+                 .position = {.name = "AAPL", .quantity = 1, .price = 1}};
+  bool accepted = engine.TrySubmit(order, FillCallback());
+  assert(!accepted);
+  uint32_t filled = engine.Submit(order).get();
+  assert(filled == 0);
+  (void)accepted;
+  (void)filled;
+}
+
+/// Submit from many threads with callbacks, and check every fill lands.
+void testEngineManyProducers() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  const uint32_t threadCount = 8;
+  const uint32_t ordersPerThread = 2000;
+  BrokerEngine engine(1e9, 256);
+
+  // Only the engine thread runs callbacks, so these need no locking.
+  uint64_t callbacks = 0;
+  uint64_t sharesBought = 0;
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < threadCount; t++) {
+    threads.emplace_back([&, t]() {
+      Order order = {.kind = Buy,
+                     .position = {.name = "SYM" + std::to_string(t),
+                                  .quantity = 1 + t,
+                                  .price = 10}};
+      for (uint32_t i = 0; i < ordersPerThread; i++) {
+        while (!engine.TrySubmit(order, [&](uint32_t filled) {
+          callbacks++;
+          sharesBought += filled;
+        })) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  engine.Stop();
+
+  uint64_t expectedShares = 0;
+  for (uint32_t t = 0; t < threadCount; t++) {
+    std::string name = "SYM" + std::to_string(t);
+    assert(engine.Client().GetPosition(name).quantity ==
+           (1 + t) * ordersPerThread);
+    expectedShares += (1 + t) * ordersPerThread;
+  }
+  assert(callbacks == threadCount * ordersPerThread);
+  assert(sharesBought == expectedShares);
+  assert(engine.Client().GetCashBalance() == 1e9 - 10.0 * expectedShares);
+}
+
+/**
+ * Measure the CPU time the whole process uses while the calling thread
+ * sleeps, so that a worker left idle shows up as the time it burns.
+ */
+static double idleCpuSeconds() {
+  std::clock_t start = std::clock();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  return (double)(std::clock() - start) / CLOCKS_PER_SEC;
+}
+
+/// Count how many times the process's threads block while the caller sleeps.
+static long idleWakeups() {
+  struct rusage before, after;
+  getrusage(RUSAGE_SELF, &before);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  getrusage(RUSAGE_SELF, &after);
+  return after.ru_nvcsw - before.ru_nvcsw;
+}
+
+/// Check idle worker threads block rather than spin, and wake for orders.
+void testIdleWorkersSleep() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  Order order = {.kind = Buy,
+                 .position = {.name = "AAPL", .quantity = 1, .price = 1}};
+
+  BrokerEngine engine(1000, 64);
+  assert(idleCpuSeconds() < 0.1);
+  uint32_t filled = engine.Submit(order).get();
+  assert(filled == 1);
+  assert(idleCpuSeconds() < 0.1);
+  filled = engine.Submit(order).get();
+  assert(filled == 1);
+
+  BrokerManager manager(4, 64);
+  bool opened = manager.OpenAccount(1, 1000);
+  assert(opened);
+  assert(idleCpuSeconds() < 0.1);
+  filled = manager.Submit(1, order).get();
+  assert(filled == 1);
+  assert(idleCpuSeconds() < 0.1);
+
+  BrokerExecutor executor(4, 64);
+  opened = executor.OpenAccount(1, 1000);
+  assert(opened);
+  assert(idleCpuSeconds() < 0.1);
+  filled = executor.Submit(1, order).get();
+  assert(filled == 1);
+  assert(idleCpuSeconds() < 0.1);
+
+  /*
+   * Nor does the worker of a client in asynchronous cost basis mode, which
+   * would otherwise sleep and wake many times while we do.
+   */
+  BrokerClient async = BrokerClient(1000);
+  opened = async.EnableAsyncCostBasis();
+  assert(opened);
+  assert(idleWakeups() < 100);
+  filled = async.SubmitOrder(order);
+  assert(filled == 1);
+  async.Flush();
+  assert(async.GetPosition("AAPL").price == 1);
+  assert(idleWakeups() < 100);
+  (void)opened;
+  (void)filled;
+}
+
+/// Check asynchronous cost basis mode converges on the synchronous result.
+void testAsyncCostBasis() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  bool ok;
+  BrokerClient client = BrokerClient(100000);
+  BrokerClient async = BrokerClient(100000);
+  ok = async.EnableAsyncCostBasis();
+  assert(ok);
+  ok = async.EnableAsyncCostBasis();
+  assert(!ok);
+
+  const char *names[] = {"AAPL", "MSFT", "GOOG"};
+  for (uint32_t i = 0; i < 5000; i++) {
+    Order order = {.kind = (i % 4 == 3) ? Sell : Buy,
+                   .position = {.name = std::string(names[i % 3]),
+                                .quantity = 1 + i % 9,
+                                .price = 10 + i % 13 + 0.5}};
+    uint32_t expected = client.SubmitOrder(order);
+    uint32_t transacted = async.SubmitOrder(order);
+    assert(transacted == expected);
+    (void)expected;
+    (void)transacted;
+
+    // Quantities and cash never lag behind.
+    SymbolId symbol = async.InternSymbol(order.position.name);
+    assert(async.GetPosition(symbol).quantity ==
+           client.GetPosition(order.position.name).quantity);
+    assert(async.GetCostBasisVersion(symbol) <=
+           async.GetPositionVersion(symbol));
+  }
+  assert(async.GetCashBalance() == client.GetCashBalance());
+
+  // Once flushed, every price is final and matches.
+  async.Flush();
+  for (const char *name : names) {
+    SymbolId symbol = async.InternSymbol(name);
+    assert(async.GetCostBasisVersion(symbol) ==
+           async.GetPositionVersion(symbol));
+    assert(positionsEqual(async.GetPosition(name), client.GetPosition(name)));
+  }
+
+  // The mode has to be chosen up front, and excludes journaling.
+  ok = client.EnableAsyncCostBasis();
+  assert(!ok);
+  ok = async.OpenJournal("/tmp/BrokerClientTests_unused_journal");
+  assert(!ok);
+  (void)ok;
+}
+
+/// Read positions and cash from other threads while orders are processed.
+void testConcurrentReaders() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  const double initialCash = 1000000;
+  BrokerClient client = BrokerClient(initialCash);
+  std::atomic<bool> done(false);
+
+  /*
+   * Every share is bought at 10, so any position read whole has an average
+   * price of exactly 10, and the cash balance only ever falls in steps of
+   * 10. A torn read would break one or the other.
+   */
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 3; r++) {
+    readers.emplace_back([&]() {
+      double lastCash = initialCash;
+      while (!done.load()) {
+        double cash = client.GetCashBalance();
+        assert(cash <= lastCash && std::fmod(cash, 10) == 0);
+        lastCash = cash;
+        for (const SecurityPosition &position : client.GetPositions()) {
+          assert(position.name[0] == 'S');
+          assert(position.quantity > 0 && position.price == 10);
+        }
+        std::shared_ptr<const std::vector<SecurityPosition>> cached =
+            client.GetCachedPositions();
+        for (const SecurityPosition &position : *cached) {
+          assert(position.quantity > 0 && position.price == 10);
+        }
+      }
+    });
+  }
+
+  // Keep adding securities too, so storage grows under the readers.
+  for (uint32_t i = 0; i < 20000; i++) {
+    Order order = {.kind = Buy,
+                   .position = {.name = "S" + std::to_string(i % 3000),
+                                .quantity = 1 + i % 4,
+                                .price = 10}};
+    client.SubmitOrder(order);
+  }
+  done.store(true);
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+  assert(client.GetPositions().size() == 3000);
+  assert(client.GetCachedPositions()->size() == 3000);
+}
+
+/// Check the cached positions track the live ones, and are shared safely.
+void testCachedPositions() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  BrokerClient client = BrokerClient(100000);
+  std::shared_ptr<const std::vector<SecurityPosition>> cached =
+      client.GetCachedPositions();
+  assert(cached->empty());
+
+  // Check a cached result against GetPositions.
+  auto matches = [&](const std::vector<SecurityPosition> &positions) {
+    std::vector<SecurityPosition> expected = client.GetPositions();
+    if (positions.size() != expected.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < expected.size(); i++) {
+      if (!positionsEqual(positions[i], expected[i])) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  const char *names[] = {"AAPL", "MSFT", "GOOG"};
+  for (const char *name : names) {
+    Order order = {.kind = Buy,
+                   .position = {.name = name, .quantity = 10, .price = 100}};
+    client.SubmitOrder(order);
+  }
+  cached = client.GetCachedPositions();
+  assert(matches(*cached));
+
+  // Nothing changed, so the same vector comes back.
+  const std::vector<SecurityPosition> *address = cached.get();
+  assert(client.GetCachedPositions().get() == address);
+
+  // A result still held is never modified; a new vector is built instead.
+  Order order = {.kind = Buy,
+                 .position = {.name = "MSFT", .quantity = 10, .price = 200}};
+  client.SubmitOrder(order);
+  std::shared_ptr<const std::vector<SecurityPosition>> updated =
+      client.GetCachedPositions();
+  assert(updated.get() != address);
+  assert((*cached)[1].quantity == 10 && (*cached)[1].price == 100);
+  assert((*updated)[1].quantity == 20 && (*updated)[1].price == 150);
+  assert(matches(*updated));
+
+  /*
+   * Once released, vectors are reused, alternating as long as each result
+   * is released before asking for the next, and catching up on the entries
+   * changed since they were built.
+   */
+  cached.reset();
+  const std::vector<SecurityPosition> *other = updated.get();
+  updated.reset();
+  order.position.name = "GOOG";
+  client.SubmitOrder(order);
+  cached = client.GetCachedPositions();
+  assert(cached.get() == address);
+  assert(matches(*cached));
+  cached.reset();
+  order.position.name = "AAPL";
+  client.SubmitOrder(order);
+  cached = client.GetCachedPositions();
+  assert(cached.get() == other);
+  assert(matches(*cached));
+  cached.reset();
+  cached = client.GetCachedPositions();
+  assert(cached.get() == other);
+
+  // Selling out of a security, or buying a new one, changes the entries.
+  order = {.kind = Sell,
+           .position = {.name = "AAPL", .quantity = 10, .price = 100}};
+  client.SubmitOrder(order);
+  order = {.kind = Buy,
+           .position = {.name = "AMZN", .quantity = 5, .price = 100}};
+  client.SubmitOrder(order);
+  assert(matches(*client.GetCachedPositions()));
+  assert(matches(*client.GetCachedPositions()));
+
+  // A security bought and sold out again between calls has no entry.
+  order.position.name = "NFLX";
+  client.SubmitOrder(order);
+  order.kind = Sell;
+  client.SubmitOrder(order);
+  cached = client.GetCachedPositions();
+  assert(matches(*cached));
+  cached.reset();
+  order = {.kind = Buy,
+           .position = {.name = "MSFT", .quantity = 1, .price = 100}};
+  client.SubmitOrder(order);
+  cached = client.GetCachedPositions();
+  assert(matches(*cached));
+}
+
+/// Check cached positions stay whole while securities are being added.
+void testCachedPositionsGrowth() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  const uint32_t count = 5000;
+  BrokerClient client = BrokerClient(1e7);
+  std::atomic<bool> done(false);
+
+  /*
+   * Every order buys one share of a new security, so readers see cached
+   * results that only ever grow, racing the writer publishing securities
+   * added since they read the number of positions.
+   */
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 3; r++) {
+    readers.emplace_back([&]() {
+      size_t lastSize = 0;
+      while (!done.load()) {
+        std::shared_ptr<const std::vector<SecurityPosition>> cached =
+            client.GetCachedPositions();
+        assert(cached->size() >= lastSize);
+        for (const SecurityPosition &position : *cached) {
+          assert(position.quantity == 1 && position.price == 10);
+        }
+        lastSize = cached->size();
+      }
+    });
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    Order order = {.kind = Buy,
+                   .position = {.name = "N" + std::to_string(i),
+                                .quantity = 1,
+                                .price = 10}};
+    client.SubmitOrder(order);
+    if (i % 64 == 0) {
+      std::this_thread::yield();
+    }
+  }
+  done.store(true);
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+
+  // No security published during an update is left out of later ones.
+  std::shared_ptr<const std::vector<SecurityPosition>> cached =
+      client.GetCachedPositions();
+  assert(cached->size() == count);
+  for (uint32_t i = 0; i < count; i++) {
+    assert((*cached)[i].name == "N" + std::to_string(i));
+  }
+}
+
+/// Check clients drawing from arenas behave exactly like clients on the heap.
+void testArenaClients() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+
+  // The arena honours alignment, including for cache-aligned records.
+  ArenaResource arena(256);
+  char *byte = static_cast<char *>(arena.Allocate(1, 1));
+  void *aligned = arena.Allocate(sizeof(SymbolState), alignof(SymbolState));
+  assert((uintptr_t)aligned % CacheLineSize == 0 && (void *)byte != aligned);
+  void *large = arena.Allocate(4096, 8);
+  assert(large != nullptr && arena.Capacity() >= 4096);
+  arena.Release();
+
+  // An arena asked for empty blocks still grows to fit each allocation.
+  ArenaResource tiny(0);
+  void *first = tiny.Allocate(100, 8);
+  assert(first != nullptr && tiny.Capacity() >= 100);
+  (void)first;
+
+  // Run the same orders through a heap client and an arena client.
+  auto trade = [](BrokerClient &client) {
+    for (uint32_t i = 0; i < 2000; i++) {
+      Order order = {.kind = i % 3 == 2 ? Sell : Buy,
+                     .position = {.name = "SYM" + std::to_string(i % 50),
+                                  .quantity = 1 + i % 7,
+                                  .price = 10 + (double)(i % 13)}};
+      client.SubmitOrder(order);
+    }
+  };
+  BrokerClient heapClient = BrokerClient(1e7);
+  trade(heapClient);
+  size_t capacity = 0;
+  for (int round = 0; round < 8; round++) {
+    {
+      BrokerClient client = BrokerClient(1e7, &arena);
+      trade(client);
+      std::vector<SecurityPosition> expected = heapClient.GetPositions();
+      std::vector<SecurityPosition> positions = client.GetPositions();
+      assert(positions.size() == expected.size());
+      for (size_t i = 0; i < expected.size(); i++) {
+        assert(positionsEqual(positions[i], expected[i]));
+      }
+      assert(client.GetTransactionCount() ==
+             heapClient.GetTransactionCount());
+      assert(client.GetCashBalance() == heapClient.GetCashBalance());
+    }
+
+    /*
+     * The largest block is kept on release, and soon grows big enough that
+     * a client fits in it without allocating from the heap at all.
+     */
+    arena.Release();
+    if (round >= 4) {
+      assert(arena.Capacity() == capacity);
+    }
+    capacity = arena.Capacity();
+  }
+
+  // A client moved into one on another arena keeps its state intact.
+  ArenaResource otherArena;
+  BrokerClient moved = BrokerClient(0, &otherArena);
+  {
+    BrokerClient client = BrokerClient(1e7, &arena);
+    trade(client);
+    moved = std::move(client);
+  }
+  assert(moved.GetPositions().size() == heapClient.GetPositions().size());
+  assert(moved.GetPosition("SYM1").quantity ==
+         heapClient.GetPosition("SYM1").quantity);
+  size_t count = moved.GetTransactionCount();
+  trade(moved);
+  assert(moved.GetTransactionCount() > count);
+}
+
+/// Check tickers hold names inline, and over-long names are refused.
+void testTickers() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  uint32_t transacted;
+  static_assert(sizeof(Ticker) == 16, "a ticker is two words");
+  static_assert(std::is_trivially_copyable<SecurityPosition>::value,
+                "positions are plain data");
+
+  Ticker aapl = "AAPL";
+  Ticker full = std::string("ABCDEFGHIJKLMNOP");
+  assert(aapl == Ticker(std::string("AAPL")) && aapl != Ticker("AAP"));
+  assert(aapl.Size() == 4 && aapl.ToString() == "AAPL" && aapl[1] == 'A');
+  assert(full.Valid() && full.Size() == Ticker::MaxLength);
+  assert(full.ToString() == "ABCDEFGHIJKLMNOP");
+  assert(Ticker("AAPL") < Ticker("AAPLX") && Ticker("AB") < Ticker("B"));
+  assert(aapl.Hash() == Ticker("AAPL").Hash() && aapl.Hash() != full.Hash());
+  assert(Ticker().Size() == 0 && Ticker().Valid());
+
+  // Orders copied as raw bytes are equal to the original.
+  Order order = {.kind = Buy,
+                 .position = {.name = full, .quantity = 10, .price = 5}};
+  Order copy;
+  memcpy(&copy, &order, sizeof(Order));
+  assert(ordersEqual(order, copy));
+
+  // A name one character too long can't be represented, so isn't traded.
+  Ticker tooLong = "ABCDEFGHIJKLMNOPQ";
+  assert(!tooLong.Valid() && tooLong != full);
+  BrokerClient client = BrokerClient(1000);
+  SymbolId symbol = client.InternSymbol("ABCDEFGHIJKLMNOPQ");
+  assert(symbol == InvalidSymbolId);
+  order.position.name = tooLong;
+  transacted = client.SubmitOrder(order);
+  assert(transacted == 0);
+  order.position.name = full;
+  transacted = client.SubmitOrder(order);
+  assert(transacted == 10);
+  symbol = client.InternSymbol(full);
+  assert(client.GetSymbolName(symbol) == full);
+  assert(client.GetPositions().size() == 1);
+
+  ConcurrentBrokerClient concurrent(1000);
+  order.position.name = tooLong;
+  transacted = concurrent.SubmitOrder(order);
+  assert(transacted == 0);
+  assert(concurrent.GetTransactionCount() == 0);
+  (void)transacted;
+}
+
+/// Check a sharded manager gives each account the result of running alone.
+void testBrokerManager() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  uint32_t transacted;
+  bool ok;
+  const uint32_t threadCount = 4;
+  const uint32_t accountsPerThread = 250;
+  const uint32_t ordersPerAccount = 20;
+  BrokerManager manager(4, 256);
+
+  // Order i of an account, the same whichever way it is submitted.
+  auto orderAt = [](AccountId account, uint32_t i) {
+    Order order = {.kind = i % 4 == 3 ? Sell : Buy,
+                   .position = {.name = "SYM" + std::to_string(i % 3),
+                                .quantity = (uint32_t)(1 + (account + i) % 5),
+                                .price = 10 + (double)(i % 7)}};
+    return order;
+  };
+
+  // Each thread opens and trades its own accounts.
+  std::atomic<uint64_t> callbackShares(0);
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < threadCount; t++) {
+    threads.emplace_back([&, t]() {
+      for (uint32_t a = 0; a < accountsPerThread; a++) {
+        bool opened = manager.OpenAccount(t * accountsPerThread + a, 1000);
+        assert(opened);
+        (void)opened;
+      }
+      for (uint32_t i = 0; i < ordersPerAccount; i++) {
+        for (uint32_t a = 0; a < accountsPerThread; a++) {
+          AccountId account = t * accountsPerThread + a;
+          while (!manager.TrySubmit(account, orderAt(account, i),
+                                    [&](uint32_t filled) {
+                                      callbackShares += filled;
+                                    })) {
+            std::this_thread::yield();
+          }
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  // Orders for accounts that were never opened fill nothing.
+  AccountId unknown = threadCount * accountsPerThread;
+  transacted = manager.Submit(unknown, orderAt(unknown, 0)).get();
+  assert(transacted == 0);
+  manager.Stop();
+  assert(manager.Account(unknown) == nullptr);
+  ok = manager.OpenAccount(unknown, 1000);
+  assert(!ok);
+
+  uint64_t shares = 0;
+  uint64_t fills = 0;
+  for (AccountId account = 0; account < unknown; account++) {
+    BrokerClient expected = BrokerClient(1000);
+    for (uint32_t i = 0; i < ordersPerAccount; i++) {
+      uint32_t filled = expected.SubmitOrder(orderAt(account, i));
+      shares += filled;
+      fills += filled != 0;
+    }
+    BrokerClient *client = manager.Account(account);
+    assert(client != nullptr);
+    assert(client->GetCashBalance() == expected.GetCashBalance());
+    std::vector<SecurityPosition> positions = client->GetPositions();
+    std::vector<SecurityPosition> expectedPositions = expected.GetPositions();
+    assert(positions.size() == expectedPositions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+      assert(positionsEqual(positions[i], expectedPositions[i]));
+    }
+  }
+
+  // Every shard got some accounts, and the stats add up.
+  BrokerManagerStats stats = manager.GetStats();
+  assert(stats.accounts == unknown);
+  assert(stats.orders == unknown * ordersPerAccount + 1);
+  assert(stats.fills == fills && stats.shares == shares);
+  assert(callbackShares.load() == shares);
+  for (size_t shard = 0; shard < manager.ShardCount(); shard++) {
+    assert(manager.GetShardStats(shard).accounts > unknown / 8);
+  }
+
+  // The time the counts cover stopped with the manager, so rates hold still.
+  assert(stats.elapsedSeconds > 0);
+  manager.Stop();
+  assert(manager.GetStats().elapsedSeconds == stats.elapsedSeconds);
+  assert(manager.GetShardStats(0).elapsedSeconds == stats.elapsedSeconds);
+  (void)transacted;
+  (void)ok;
+}
+
+/// Check a burst on one account neither reorders nor holds up the others.
+void testBrokerExecutor() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  uint32_t transacted;
+  bool ok;
+  const uint32_t accountCount = 100;
+  const uint32_t burstOrders = 20000;
+  const uint32_t ordersPerAccount = 50;
+  BrokerExecutor executor(4, 1 << 10);
+  for (AccountId account = 0; account < accountCount; account++) {
+    ok = executor.OpenAccount(account, 1000);
+    assert(ok);
+  }
+  ok = executor.OpenAccount(0, 1000);
+  assert(!ok);
+
+  auto orderAt = [](AccountId account, uint32_t i) {
+    Order order = {.kind = i % 4 == 3 ? Sell : Buy,
+                   .position = {.name = "SYM" + std::to_string(i % 3),
+                                .quantity = (uint32_t)(1 + (account + i) % 5),
+                                .price = 10 + (double)(i % 7)}};
+    return order;
+  };
+  auto ordersFor = [&](AccountId account) {
+    return account == 0 ? burstOrders : ordersPerAccount;
+  };
+
+  /*
+   * One thread floods account 0 while three others trade the rest. Each
+   * callback checks its order is the next one for its account; the counts
+   * are plain integers, so two threads running an account at once would
+   * also be a data race.
+   */
+  std::vector<uint32_t> seen(accountCount, 0);
+  auto submitAll = [&](AccountId first, AccountId last) {
+    for (uint32_t i = 0; i < ordersFor(first); i++) {
+      for (AccountId account = first; account < last; account++) {
+        while (!executor.TrySubmit(account, orderAt(account, i),
+                                   [&seen, account, i](uint32_t) {
+                                     assert(seen[account] == i);
+                                     seen[account]++;
+                                   })) {
+          std::this_thread::yield();
+        }
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.emplace_back(submitAll, 0, 1);
+  threads.emplace_back(submitAll, 1, 34);
+  threads.emplace_back(submitAll, 34, 67);
+  threads.emplace_back(submitAll, 67, accountCount);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  transacted = executor.Submit(accountCount, orderAt(0, 0)).get();
+  assert(transacted == 0);
+  executor.Stop();
+  assert(executor.Account(accountCount) == nullptr);
+
+  uint64_t shares = 0;
+  for (AccountId account = 0; account < accountCount; account++) {
+    assert(seen[account] == ordersFor(account));
+    BrokerClient expected = BrokerClient(1000);
+    for (uint32_t i = 0; i < ordersFor(account); i++) {
+      shares += expected.SubmitOrder(orderAt(account, i));
+    }
+    BrokerClient *client = executor.Account(account);
+    assert(client->GetCashBalance() == expected.GetCashBalance());
+    std::vector<SecurityPosition> positions = client->GetPositions();
+    std::vector<SecurityPosition> expectedPositions = expected.GetPositions();
+    assert(positions.size() == expectedPositions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+      assert(positionsEqual(positions[i], expectedPositions[i]));
+    }
+  }
+  BrokerExecutorStats stats = executor.GetStats();
+  assert(executor.AccountCount() == accountCount);
+  assert(stats.orders == burstOrders + (accountCount - 1) * ordersPerAccount);
+  assert(stats.shares == shares);
+
+  /*
+   * Block an account's worker in a callback until an account sharing its
+   * home worker runs, which can only happen if one of them is stolen.
+   */
+  BrokerExecutor stealing(2);
+  AccountId blocked = 0;
+  AccountId other = 1;
+  while (stealing.HomeOf(other) != stealing.HomeOf(blocked)) {
+    other++;
+  }
+  stealing.OpenAccount(blocked, 1000);
+  stealing.OpenAccount(other, 1000);
+  std::atomic<bool> released(false);
+  stealing.TrySubmit(blocked, orderAt(blocked, 0), [&](uint32_t) {
+    while (!released.load()) {
+      std::this_thread::yield();
+    }
+  });
+  stealing.TrySubmit(other, orderAt(other, 0),
+                     [&](uint32_t) { released.store(true); });
+  stealing.Stop();
+  assert(released.load());
+  assert(stealing.GetStats().steals >= 1);
+
+  // Once an account goes idle, the callbacks it ran are released.
+  BrokerExecutor idle(1, 16);
+  ok = idle.OpenAccount(0, 1000);
+  assert(ok);
+  std::shared_ptr<int> token = std::make_shared<int>(0);
+  std::atomic<bool> ran(false);
+  ok = idle.TrySubmit(0, orderAt(0, 0),
+                      [token, &ran](uint32_t) { ran.store(true); });
+  assert(ok);
+  for (int i = 0; i < 1000 && (!ran.load() || token.use_count() > 1); i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  assert(token.use_count() == 1);
+  (void)transacted;
+  (void)ok;
+}
+
+/**
+ * Buy three lots and sell half the position under a cost basis policy,
+ * returning what is left.
+ */
+template <typename Client> static SecurityPosition sellHalfOfThreeLots() {
+  uint32_t transacted;
+  Client client = Client(1000);
+  SymbolId spy = client.InternSymbol("SPY");
+  transacted = client.SubmitOrder(Buy, spy, 10, 1);
+  assert(transacted == 10);
+  transacted = client.SubmitOrder(Buy, spy, 10, 3);
+  assert(transacted == 10);
+  transacted = client.SubmitOrder(Buy, spy, 10, 2);
+  assert(transacted == 10);
+  transacted = client.SubmitOrder(Sell, spy, 15, 5);
+  assert(transacted == 15);
+  assert(client.GetCashBalance() == 1000 - 60 + 75);
+  (void)transacted;
+  return client.GetPosition(spy);
+}
+
+/**
+ * Trade a long stream under a cost basis policy, checking the cost basis
+ * after every order against a plain list of lots, from which a selector
+ * picks the index of the next lot each sale takes.
+ */
+template <typename Client, typename Selector>
+static void checkAgainstLotList(Selector select) {
+  uint32_t transacted;
+  Client client = Client(1e9);
+  SymbolId spy = client.InternSymbol("SPY");
+  std::vector<Lot> lots;
+  for (uint32_t i = 0; i < 5000; i++) {
+    uint32_t quantity = 1 + i * 7 % 13;
+    if (i % 3 != 2) {
+      Lot lot = {.quantity = quantity, .price = ToMoney(1 + i * 5 % 17)};
+      lots.push_back(lot);
+      transacted = client.SubmitOrder(Buy, spy, quantity, 1 + i * 5 % 17);
+      assert(transacted > 0);
+      continue;
+    }
+
+    // Sell more than the newest lot holds, so most sales span several.
+    uint32_t remaining = client.SubmitOrder(Sell, spy, 2 * quantity, 1);
+    while (remaining > 0) {
+      size_t next = select(lots);
+      uint32_t taken = std::min(remaining, lots[next].quantity);
+      lots[next].quantity -= taken;
+      remaining -= taken;
+      if (lots[next].quantity == 0) {
+        lots.erase(lots.begin() + next);
+      }
+    }
+
+    uint64_t quantityHeld = 0;
+    double cost = 0;
+    for (const Lot &lot : lots) {
+      quantityHeld += lot.quantity;
+      cost += lot.quantity * FromMoney(lot.price);
+    }
+    SecurityPosition position = client.GetPosition(spy);
+    assert(position.quantity == quantityHeld);
+    assert(quantityHeld == 0 || position.price == cost / quantityHeld);
+  }
+  (void)transacted;
+}
+
+/// Check each cost basis policy takes the shares it should from each sale.
+void testCostBasisPolicies() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+
+  // Lots of 10 at 1, 3 and 2, less 15 shares taken as each policy chooses.
+  SecurityPosition fifo = sellHalfOfThreeLots<BrokerClient>();
+  SecurityPosition lifo = sellHalfOfThreeLots<LifoBrokerClient>();
+  SecurityPosition hifo = sellHalfOfThreeLots<HifoBrokerClient>();
+  SecurityPosition average = sellHalfOfThreeLots<AverageCostBrokerClient>();
+  assert(fifo.quantity == 15 && fifo.price == (5 * 3 + 10 * 2) / 15.0);
+  assert(lifo.quantity == 15 && lifo.price == (10 * 1 + 5 * 3) / 15.0);
+  assert(hifo.quantity == 15 && hifo.price == (10 * 1 + 5 * 2) / 15.0);
+  assert(average.quantity == 15 && average.price == 2);
+
+  // Long streams against a reference list of lots, oldest first.
+  checkAgainstLotList<BrokerClient>([](const std::vector<Lot> &) {
+    return (size_t)0;
+  });
+  checkAgainstLotList<LifoBrokerClient>(
+      [](const std::vector<Lot> &lots) { return lots.size() - 1; });
+  checkAgainstLotList<HifoBrokerClient>([](const std::vector<Lot> &lots) {
+    size_t highest = 0;
+    for (size_t i = 1; i < lots.size(); i++) {
+      if (lots[i].price > lots[highest].price) {
+        highest = i;
+      }
+    }
+    return highest;
+  });
+
+  // Average cost keeps no lots, and selling out leaves no residue.
+  AverageCostBrokerClient client = AverageCostBrokerClient(1000);
+  SymbolId spy = client.InternSymbol("SPY");
+  client.SubmitOrder(Buy, spy, 3, 1);
+  client.SubmitOrder(Buy, spy, 4, 2.5);
+  client.SubmitOrder(Sell, spy, 2, 1);
+  assert(std::fabs(client.GetPosition(spy).price - 13 / 7.0) < 1e-4);
+  client.SubmitOrder(Sell, spy, 5, 1);
+  assert(client.GetPositions().empty());
+  client.SubmitOrder(Buy, spy, 1, 4);
+  assert(client.GetPosition(spy).price == 4);
+
+  // Asynchronous cost basis mode follows the client's policy.
+  HifoBrokerClient sync = HifoBrokerClient(100000);
+  HifoBrokerClient async = HifoBrokerClient(100000);
+  bool enabled = async.EnableAsyncCostBasis();
+  assert(enabled);
+  (void)enabled;
+  for (uint32_t i = 0; i < 2000; i++) {
+    Order order = {.kind = (i % 4 == 3) ? Sell : Buy,
+                   .position = {.name = "SPY",
+                                .quantity = 1 + i % 9,
+                                .price = 10 + (double)(i % 13)}};
+    uint32_t expected = sync.SubmitOrder(order);
+    uint32_t transacted = async.SubmitOrder(order);
+    assert(transacted == expected);
+    (void)expected;
+    (void)transacted;
+  }
+  async.Flush();
+  assert(positionsEqual(async.GetPosition("SPY"), sync.GetPosition("SPY")));
+}
+
+/// Check checkpoints restore a policy's lots, and only for that policy.
+void testCostBasisCheckpoints() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  bool ok;
+  char directory[] = "/tmp/BrokerClientTests_policies_XXXXXX";
+  char *created = mkdtemp(directory);
+  assert(created != nullptr);
+  (void)created;
+  std::string journalPath = std::string(directory) + "/journal";
+
+  // Journal a LIFO client, alongside unjournaled clients of two policies.
+  LifoBrokerClient lifo = LifoBrokerClient(1000000);
+  AverageCostBrokerClient average = AverageCostBrokerClient(1000000);
+  uint64_t sequence;
+  {
+    LifoBrokerClient original = LifoBrokerClient(1000000);
+    ok = original.OpenJournal(journalPath, directory, 1000);
+    assert(ok);
+    for (uint32_t i = 0; i < 1500; i++) {
+      Order order = {.kind = (i % 5 == 4) ? Sell : Buy,
+                     .position = {.name = "SPY",
+                                  .quantity = 1 + i % 13,
+                                  .price = (double)(20 + i % 17)}};
+      original.SubmitOrder(order);
+      lifo.SubmitOrder(order);
+      average.SubmitOrder(order);
+    }
+    sequence = original.GetSequenceNumber();
+    assert(sequence > 1000);
+  }
+
+  // Another policy can't use the checkpoint's lots, so replays everything.
+  AverageCostBrokerClient replayed = AverageCostBrokerClient(0);
+  ok = replayed.OpenJournal(journalPath, directory, 0);
+  assert(ok);
+  assert(replayed.GetTransactionCount() == sequence);
+  assert(replayed.GetCashBalance() == average.GetCashBalance());
+  assert(positionsEqual(replayed.GetPosition("SPY"),
+                        average.GetPosition("SPY")));
+  assert(replayed.GetRealizedPnL() == average.GetRealizedPnL());
+
+  // The same policy starts from the checkpoint, and sells its lots alike.
+  LifoBrokerClient restored = LifoBrokerClient(0);
+  ok = restored.OpenJournal(journalPath, directory, 0);
+  assert(ok);
+  assert(restored.GetTransactionCount() == sequence - 1000);
+  Order sale = {.kind = Sell,
+                .position = {.name = "SPY", .quantity = 40, .price = 30}};
+  uint32_t expected = lifo.SubmitOrder(sale);
+  uint32_t transacted = restored.SubmitOrder(sale);
+  assert(transacted == expected);
+  (void)expected;
+  (void)transacted;
+  assert(positionsEqual(restored.GetPosition("SPY"), lifo.GetPosition("SPY")));
+
+  // Realized profit and loss carries over from the checkpoint.
+  SymbolId spy = restored.InternSymbol("SPY");
+  assert(restored.GetRealizedPnL(spy) ==
+         lifo.GetRealizedPnL(lifo.InternSymbol("SPY")));
+  assert(restored.GetRealizedPnL() == lifo.GetRealizedPnL());
+
+  unlink(CheckpointPath(directory, 1000).c_str());
+  unlink(journalPath.c_str());
+  rmdir(directory);
+  (void)ok;
+}
+
+/**
+ * Trade two securities through a client, and check the profit and loss
+ * realized under its cost basis policy.
+ *
+ * @param[in] client
+ *    The client, with at least 5000 of cash and no orders yet.
+ *
+ * @param[in] firstSale
+ *    Profit or loss the policy realizes selling 15 of 20 shares of SPY,
+ *    10 bought at 100 and then 10 at 120, at 130.
+ */
+template <typename Client>
+static void checkRealizedPnL(Client &client, double firstSale) {
+  SymbolId spy = client.InternSymbol("SPY");
+  SymbolId qqq = client.InternSymbol("QQQ");
+  client.SubmitOrder(Buy, spy, 10, 100);
+  client.SubmitOrder(Buy, spy, 10, 120);
+  client.SubmitOrder(Sell, spy, 15, 130);
+  client.Flush();
+  assert(client.GetRealizedPnL(spy) == firstSale);
+  assert(client.GetRealizedPnL(qqq) == 0);
+  assert(client.GetRealizedPnL() == firstSale);
+
+  // Closing out realizes the rest, so the total is alike under any policy.
+  client.SubmitOrder(Sell, spy, 5, 110);
+  client.SubmitOrder(Buy, qqq, 5, 10);
+  client.SubmitOrder(Sell, qqq, 5, 8);
+  client.Flush();
+  assert(client.GetRealizedPnL(spy) == 1950 + 550 - 2200);
+  assert(client.GetRealizedPnL(qqq) == -10);
+  assert(client.GetRealizedPnL() == 300 - 10);
+}
+
+void testRealizedPnL() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  BrokerClient fifo = BrokerClient(5000);
+  checkRealizedPnL(fifo, 1950 - (1000 + 600));
+  LifoBrokerClient lifo = LifoBrokerClient(5000);
+  checkRealizedPnL(lifo, 1950 - (1200 + 500));
+  HifoBrokerClient hifo = HifoBrokerClient(5000);
+  checkRealizedPnL(hifo, 1950 - (1200 + 500));
+  AverageCostBrokerClient average = AverageCostBrokerClient(5000);
+  checkRealizedPnL(average, 1950 - 15 * 110);
+
+  // The worker realizes sales in asynchronous cost basis mode.
+  BrokerClient async = BrokerClient(5000);
+  bool enabled = async.EnableAsyncCostBasis();
+  assert(enabled);
+  (void)enabled;
+  checkRealizedPnL(async, 1950 - (1000 + 600));
+
+  // A losing sale is realized too, and the concurrent client keeps both.
+  ConcurrentBrokerClient concurrent(5000);
+  SymbolId spy = concurrent.InternSymbol("SPY");
+  concurrent.SubmitOrder(Buy, spy, 10, 100);
+  concurrent.SubmitOrder(Buy, spy, 10, 120);
+  concurrent.SubmitOrder(Sell, spy, 15, 90);
+  assert(concurrent.GetRealizedPnL(spy) == 1350 - (1000 + 600));
+  assert(concurrent.GetRealizedPnL() == 1350 - (1000 + 600));
+}
+
+/**
+ * Check a valuation of a client's positions against one worked out from
+ * GetPosition, security by security.
+ *
+ * @param[in] client
+ *    The client, whose cost basis must be up to date.
+ *
+ * @param[in] prices
+ *    Current price of every security the client has interned.
+ */
+template <typename Client>
+static void checkValuation(const Client &client,
+                           const std::vector<double> &prices) {
+  size_t count = client.GetSymbolCount();
+  std::vector<double> values(count), unrealized(count), weights(count);
+  Valuation total = client.Valuate(prices.data(), values.data(),
+                                   unrealized.data(), weights.data());
+
+  double marketValue = 0;
+  double costBasis = 0;
+  double weightSum = 0;
+  for (SymbolId symbol = 0; symbol < count; symbol++) {
+    SecurityPosition position = client.GetPosition(symbol);
+    double value = position.quantity * prices[symbol];
+    double cost = position.quantity * position.price;
+    assert(std::fabs(values[symbol] - value) < 1e-6);
+    assert(std::fabs(unrealized[symbol] - (value - cost)) < 1e-6);
+    marketValue += value;
+    costBasis += cost;
+    weightSum += weights[symbol];
+  }
+  assert(std::fabs(total.marketValue - marketValue) < 1e-6);
+  assert(std::fabs(total.costBasis - costBasis) < 1e-6);
+  assert(std::fabs(total.unrealizedPnL - (marketValue - costBasis)) < 1e-6);
+  for (SymbolId symbol = 0; symbol < count; symbol++) {
+    assert(std::fabs(weights[symbol] - values[symbol] / marketValue) < 1e-12);
+  }
+  assert(std::fabs(weightSum - 1) < 1e-9);
+}
+
+void testValuate() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  BrokerClient client = BrokerClient(1000000);
+  BrokerClient async = BrokerClient(1000000);
+  bool enabled = async.EnableAsyncCostBasis();
+  assert(enabled);
+  (void)enabled;
+
+  // An empty portfolio is worth nothing, and has no weights.
+  Valuation empty = client.Valuate(nullptr, nullptr, nullptr, nullptr);
+  assert(empty.marketValue == 0 && empty.costBasis == 0);
+
+  // Enough securities to fill the vector lanes and leave a remainder.
+  std::vector<double> prices;
+  for (uint32_t i = 0; i < 19; i++) {
+    std::string name = "SYM" + std::to_string(i);
+    for (BrokerClient *target : {&client, &async}) {
+      SymbolId symbol = target->InternSymbol(name);
+      target->SubmitOrder(Buy, symbol, 10 + i, 20 + i % 7);
+      target->SubmitOrder(Buy, symbol, 5, 1 + 0.25 * i);
+      target->SubmitOrder(Sell, symbol, i % 4 == 0 ? 15 + i : 3, 30);
+    }
+    prices.push_back(25 + 0.5 * i);
+  }
+  async.Flush();
+  checkValuation(client, prices);
+  checkValuation(async, prices);
+
+  // A closed position is worth nothing, whatever its price.
+  std::vector<double> values(19), unrealized(19), weights(19);
+  client.Valuate(prices.data(), values.data(), unrealized.data(),
+                 weights.data());
+  assert(client.GetPosition(SymbolId(0)).quantity == 0);
+  assert(values[0] == 0 && unrealized[0] == 0 && weights[0] == 0);
+
+  // Repricing after more orders sees them straight away.
+  client.SubmitOrder(Buy, client.InternSymbol("SYM3"), 100, 10);
+  prices[3] = 12;
+  checkValuation(client, prices);
+}
+
+/// Check order files round trip, and lines with bad quantities are refused.
+void testReadOrders() {
+  std::cout << " * Running test: " << __FUNCTION__ << std::endl;
+  std::string path =
+      "/tmp/BrokerClientTests_orders_" + std::to_string(getpid());
+  std::vector<Order> orders;
+  Order order = {.kind = Buy,
+                 .position = {.name = "AAPL", .quantity = 10, .price = 1.5}};
+  orders.push_back(order);
+  order = {.kind = Sell,
+           .position = {.name = "MSFT", .quantity = UINT32_MAX, .price = 2}};
+  orders.push_back(order);
+  bool ok = WriteOrders(path, orders);
+  assert(ok);
+
+  std::vector<Order> read;
+  ok = ReadOrders(path, read);
+  assert(ok);
+  assert(read.size() == orders.size());
+  for (size_t i = 0; i < orders.size(); i++) {
+    assert(ordersEqual(read[i], orders[i]));
+  }
+
+  /*
+   * A negative quantity, or one too large, is malformed rather than wrapped,
+   * as is a price that isn't positive and finite, or a trailing field.
+   */
+  const char *lines[] = {"BUY AAPL -5 10",
+                         "SELL AAPL 4294967296 10",
+                         "BUY AAPL 99999999999999999999 10",
+                         "BUY AAPL 10 0",
+                         "BUY AAPL 10 -2.5",
+                         "BUY AAPL 10 1e400",
+                         "BUY AAPL 10 nan",
+                         "BUY AAPL 10 1.5 20"};
+  for (const char *line : lines) {
+    std::ofstream(path) << line << "\n";
+    read.clear();
+    ok = ReadOrders(path, read);
+    assert(!ok);
+  }
+
+  // Trailing whitespace is still fine.
+  std::ofstream(path) << "BUY AAPL 10 1.5  \t\n";
+  read.clear();
+  ok = ReadOrders(path, read);
+  assert(ok && read.size() == 1 && ordersEqual(read[0], orders[0]));
+  unlink(path.c_str());
+  (void)ok;
+}
+
 int main(void) {
   std::cout << "Running BrokerClientTests" << std::endl;
   testEmpty();
@@ -173,5 +1994,36 @@ int main(void) {
   testBuySellSimple();
   testBuySellCheckProfit();
   testSellNone();
+  testSubmitBySymbolId();
+  testMultipleSymbols();
+  testSellAcrossManyLots();
+  testLongHeldPosition();
+  testLiquidateManyMicroLots();
+  testSubmitOrdersBatch();
+  testTransactionRange();
+  testFractionalPrices();
+  testGetPosition();
+  testJournalReplay();
+  testCheckpointRecovery();
+  testCorruptCheckpoint();
+  testChunkedArray();
+  testConcurrentMatchesSequential();
+  testConcurrentOrders();
+  testEngineFutures();
+  testEngineManyProducers();
+  testIdleWorkersSleep();
+  testAsyncCostBasis();
+  testConcurrentReaders();
+  testCachedPositions();
+  testCachedPositionsGrowth();
+  testArenaClients();
+  testTickers();
+  testBrokerManager();
+  testBrokerExecutor();
+  testCostBasisPolicies();
+  testCostBasisCheckpoints();
+  testRealizedPnL();
+  testValuate();
+  testReadOrders();
   std::cout << "All tests passed!" << std::endl;
 }
@@ -0,0 +1,105 @@
+/**
+ * @file BrokerEngine.cpp
+ *
+ * File containing the implementation of the BrokerEngine.
+ */
+
+#include "BrokerEngine.hpp"
+#include <memory>
+
+/// Number of empty polls of the queue before the engine starts yielding.
+static const uint32_t EngineSpinLimit = 64;
+
+/// Number of empty polls of the queue before the engine blocks.
+static const uint32_t EngineYieldLimit = 1024;
+
+BrokerEngine::BrokerEngine(double cashBalance, size_t queueCapacity)
+    : client_(cashBalance), queue_(queueCapacity), stopping_(false),
+      producers_(0) {
+  thread_ = std::thread(&BrokerEngine::Run, this);
+}
+
+BrokerEngine::~BrokerEngine() { Stop(); }
+
+bool BrokerEngine::TrySubmit(const Order &order, FillCallback callback) {
+  /*
+   * Announce ourselves before checking whether the engine is stopping. Stop
+   * sets the flag before checking for producers, so either we see the flag
+   * and back out, or Stop sees us and waits for our order to land.
+   */
+  producers_.fetch_add(1);
+  if (stopping_.load()) {
+    producers_.fetch_sub(1);
+    return false;
+  }
+
+  Request request = {.order = order, .callback = std::move(callback)};
+  bool pushed = queue_.TryPush(request);
+  if (pushed) {
+    idle_.Notify();
+  }
+  producers_.fetch_sub(1);
+  return pushed;
+}
+
+std::future<uint32_t> BrokerEngine::Submit(const Order &order) {
+  std::shared_ptr<std::promise<uint32_t>> promise =
+      std::make_shared<std::promise<uint32_t>>();
+  std::future<uint32_t> future = promise->get_future();
+  FillCallback callback = [promise](uint32_t filled) {
+    promise->set_value(filled);
+  };
+
+  while (!TrySubmit(order, callback)) {
+    if (stopping_.load()) {
+      promise->set_value(0);
+      break;
+    }
+    std::this_thread::yield();
+  }
+  return future;
+}
+
+void BrokerEngine::Stop() {
+  stopping_.store(true);
+  idle_.NotifyAll();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void BrokerEngine::Run() {
+  Request request;
+  uint32_t idlePolls = 0;
+  for (;;) {
+    /*
+     * Check whether we're stopping before polling. If so, and no producer
+     * was part way through an enqueue, then every order has already landed
+     * in the queue, and finding it empty means we're done.
+     */
+    bool finished = stopping_.load() && producers_.load() == 0;
+
+    if (queue_.TryPop(request)) {
+      uint32_t filled = client_.SubmitOrder(request.order);
+      if (request.callback) {
+        request.callback(filled);
+      }
+      idlePolls = 0;
+      continue;
+    }
+    if (finished) {
+      return;
+    }
+
+    /*
+     * Spin briefly in case more orders are about to arrive, then yield, and
+     * once there's clearly no work, block until a producer wakes us.
+     */
+    idlePolls++;
+    if (idlePolls > EngineYieldLimit) {
+      idle_.Park([this]() { return !queue_.Empty() || stopping_.load(); });
+    } else if (idlePolls > EngineSpinLimit) {
+      std::this_thread::yield();
+    }
+  }
+}
@@ -0,0 +1,138 @@
+/**
+ * @file BrokerEngine.hpp
+ *
+ * Header file describing a BrokerEngine, which runs a BrokerClient on a
+ * dedicated thread fed by a lock-free queue of orders.
+ */
+
+#pragma once
+
+#include "BrokerClient.hpp"
+#include "IdleWaiter.hpp"
+#include "MpscQueue.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <thread>
+
+/// Callback invoked with the number of shares bought or sold by an order.
+typedef std::function<void(uint32_t filled)> FillCallback;
+
+/**
+ * @class BrokerEngine
+ *
+ * Single-writer engine for a BrokerClient. Any number of producer threads
+ * enqueue orders into a bounded lock-free queue, and a dedicated engine
+ * thread drains it and applies the orders to the client in queue order.
+ * Since only the engine thread ever touches the client, the client itself
+ * takes no locks, and producers only contend on the queue's tail.
+ *
+ * Each producer learns the outcome of its order through a future or a
+ * callback. Callbacks run on the engine thread, between orders, so they may
+ * read the client's state but must not block.
+ *
+ * An engine thread with nothing to do spins briefly, then yields, and then
+ * blocks until a producer enqueues an order, so an idle engine uses no CPU.
+ * The cost is a full fence on every enqueue, to check for a sleeping engine,
+ * and a thread wakeup for the first order after the engine has blocked.
+ */
+class BrokerEngine {
+public:
+  /**
+   * Constructor for the BrokerEngine, which starts the engine thread.
+   *
+   * @param[in] cashBalance
+   *    The initial amount of cash that the client will be instantiated with.
+   *
+   * @param[in] queueCapacity
+   *    Maximum number of orders waiting to be processed, which must be a
+   *    power of two.
+   */
+  BrokerEngine(double cashBalance, size_t queueCapacity = 1 << 16);
+
+  /// Destructor, which stops the engine as for Stop().
+  ~BrokerEngine();
+  BrokerEngine(const BrokerEngine &) = delete;
+  BrokerEngine &operator=(const BrokerEngine &) = delete;
+
+  /**
+   * Enqueue an order if there is room, from any thread.
+   *
+   * @param[in] order
+   *    The order to submit.
+   *
+   * @param[in] callback
+   *    Called on the engine thread with the number of shares bought or sold,
+   *    once the order has been processed. May be empty.
+   *
+   * @retval
+   *    True if the order was enqueued, false if the queue is full or the
+   *    engine has been stopped.
+   */
+  bool TrySubmit(const Order &order, FillCallback callback);
+
+  /**
+   * Enqueue an order, from any thread, waiting for room if the queue is
+   * full.
+   *
+   * @param[in] order
+   *    The order to submit.
+   *
+   * @retval
+   *    A future resolving to the number of shares bought or sold, or to zero
+   *    if the engine has been stopped.
+   */
+  std::future<uint32_t> Submit(const Order &order);
+
+  /**
+   * Stop accepting orders, wait for every order already enqueued to be
+   * processed, and stop the engine thread. Must not be called from a
+   * callback.
+   */
+  void Stop();
+
+  /**
+   * Get the client the engine applies orders to.
+   *
+   * @note
+   *    The client is owned by the engine thread. It may only be used from
+   *    callbacks, or once the engine has been stopped.
+   *
+   * @retval
+   *    The engine's client.
+   */
+  BrokerClient &Client() { return client_; }
+
+private:
+  /// Struct representing an order waiting in the queue.
+  typedef struct {
+    /// The order to process.
+    Order order;
+
+    /// Called with the outcome of the order, unless empty.
+    FillCallback callback;
+  } Request;
+
+  /// The client orders are applied to, only touched by the engine thread.
+  BrokerClient client_;
+
+  /// Orders waiting to be processed.
+  MpscQueue<Request> queue_;
+
+  /// Set once the engine stops accepting orders.
+  std::atomic<bool> stopping_;
+
+  /// Number of producers currently enqueueing, so Stop can wait them out.
+  std::atomic<uint32_t> producers_;
+
+  /// Blocks the engine thread while the queue stays empty.
+  IdleWaiter idle_;
+
+  /// Thread draining the queue.
+  std::thread thread_;
+
+  /// Body of the engine thread, draining the queue until stopped.
+  void Run();
+};
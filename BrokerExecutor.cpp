@@ -0,0 +1,284 @@
+/**
+ * @file BrokerExecutor.cpp
+ *
+ * File containing the implementation of the BrokerExecutor.
+ */
+
+#include "BrokerExecutor.hpp"
+#include <algorithm>
+#include <cassert>
+
+/// Number of stripes of the table of accounts.
+static const size_t AccountStripeCount = 64;
+
+/// Maximum number of orders run in one turn of an account.
+static const size_t TurnLimit = 256;
+
+/// Number of empty polls of the ready queues before a worker starts yielding.
+static const uint32_t WorkerSpinLimit = 64;
+
+/// Number of empty polls of the ready queues before a worker blocks.
+static const uint32_t WorkerYieldLimit = 1024;
+
+BrokerExecutor::BrokerExecutor(size_t workerCount, size_t mailboxCapacity)
+    : mailboxCapacity_(mailboxCapacity), workers_(workerCount),
+      stripes_(AccountStripeCount), accountCount_(0), stopping_(false) {
+  assert(workerCount > 0 && mailboxCapacity > 0);
+
+  // Only start the workers once every worker exists, since they steal.
+  for (size_t i = 0; i < workers_.size(); i++) {
+    workers_[i].thread = std::thread(&BrokerExecutor::Run, this, i);
+  }
+}
+
+BrokerExecutor::~BrokerExecutor() { Stop(); }
+
+size_t BrokerExecutor::HomeOf(AccountId account) const {
+  return (size_t)(HashAccountId(account) % workers_.size());
+}
+
+bool BrokerExecutor::OpenAccount(AccountId account, double cashBalance) {
+  if (stopping_.load()) {
+    return false;
+  }
+  AccountStripe &stripe =
+      stripes_[(HashAccountId(account) >> 32) % AccountStripeCount];
+  std::unique_lock<std::shared_timed_mutex> lock(stripe.mutex);
+  if (stripe.accounts.find(account) != stripe.accounts.end()) {
+    return false;
+  }
+  stripe.accounts.emplace(
+      account, std::unique_ptr<AccountState>(new AccountState(cashBalance)));
+  accountCount_++;
+  return true;
+}
+
+BrokerExecutor::AccountState *BrokerExecutor::Find(AccountId account) {
+  AccountStripe &stripe =
+      stripes_[(HashAccountId(account) >> 32) % AccountStripeCount];
+  std::shared_lock<std::shared_timed_mutex> lock(stripe.mutex);
+  auto it = stripe.accounts.find(account);
+  return it == stripe.accounts.end() ? nullptr : it->second.get();
+}
+
+void BrokerExecutor::Schedule(Worker &worker, AccountState *account) {
+  {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.ready.push_back(account);
+    worker.readyCount.store(worker.ready.size(), std::memory_order_relaxed);
+  }
+  idle_.Notify();
+}
+
+bool BrokerExecutor::TrySubmit(AccountId account, const Order &order,
+                               FillCallback callback) {
+  AccountState *state = Find(account);
+  if (state == nullptr) {
+    if (callback) {
+      callback(0);
+    }
+    return true;
+  }
+  Worker &home = workers_[HomeOf(account)];
+
+  // As in BrokerEngine, announce ourselves before checking for a stop.
+  home.producers.fetch_add(1);
+  if (stopping_.load()) {
+    home.producers.fetch_sub(1);
+    return false;
+  }
+
+  /*
+   * Add the order to the chain, and if the chain was idle, schedule it on
+   * the home worker. Whoever holds a scheduled chain picks the order up.
+   */
+  bool schedule = false;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->incoming.size() >= mailboxCapacity_) {
+      home.producers.fetch_sub(1);
+      return false;
+    }
+    state->incoming.push_back(
+        {.order = order, .callback = std::move(callback)});
+    schedule = !state->scheduled;
+    state->scheduled = true;
+  }
+  if (schedule) {
+    Schedule(home, state);
+  }
+  home.producers.fetch_sub(1);
+  return true;
+}
+
+std::future<uint32_t> BrokerExecutor::Submit(AccountId account,
+                                             const Order &order) {
+  std::shared_ptr<std::promise<uint32_t>> promise =
+      std::make_shared<std::promise<uint32_t>>();
+  std::future<uint32_t> future = promise->get_future();
+  FillCallback callback = [promise](uint32_t filled) {
+    promise->set_value(filled);
+  };
+
+  while (!TrySubmit(account, order, callback)) {
+    if (stopping_.load()) {
+      promise->set_value(0);
+      break;
+    }
+    std::this_thread::yield();
+  }
+  return future;
+}
+
+void BrokerExecutor::Stop() {
+  stopping_.store(true);
+  idle_.NotifyAll();
+  for (Worker &worker : workers_) {
+    if (worker.thread.joinable()) {
+      worker.thread.join();
+    }
+  }
+}
+
+BrokerClient *BrokerExecutor::Account(AccountId account) {
+  AccountState *state = Find(account);
+  return state == nullptr ? nullptr : &state->client;
+}
+
+BrokerExecutorStats BrokerExecutor::GetStats() const {
+  BrokerExecutorStats total = {
+      .orders = 0, .fills = 0, .shares = 0, .steals = 0};
+  for (size_t i = 0; i < workers_.size(); i++) {
+    BrokerExecutorStats stats = GetWorkerStats(i);
+    total.orders += stats.orders;
+    total.fills += stats.fills;
+    total.shares += stats.shares;
+    total.steals += stats.steals;
+  }
+  return total;
+}
+
+BrokerExecutorStats BrokerExecutor::GetWorkerStats(size_t worker) const {
+  const Worker &source = workers_[worker];
+  BrokerExecutorStats stats = {
+      .orders = source.orders.load(std::memory_order_relaxed),
+      .fills = source.fills.load(std::memory_order_relaxed),
+      .shares = source.shares.load(std::memory_order_relaxed),
+      .steals = source.steals.load(std::memory_order_relaxed)};
+  return stats;
+}
+
+BrokerExecutor::AccountState *BrokerExecutor::Take(size_t index) {
+  Worker &self = workers_[index];
+  if (self.readyCount.load(std::memory_order_relaxed) != 0) {
+    std::lock_guard<std::mutex> lock(self.mutex);
+    if (!self.ready.empty()) {
+      AccountState *account = self.ready.front();
+      self.ready.pop_front();
+      self.readyCount.store(self.ready.size(), std::memory_order_relaxed);
+      return account;
+    }
+  }
+
+  // Our queue is empty, so steal a whole chain from the next busy worker.
+  for (size_t i = 1; i < workers_.size(); i++) {
+    Worker &victim = workers_[(index + i) % workers_.size()];
+    if (victim.readyCount.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.ready.empty()) {
+      AccountState *account = victim.ready.back();
+      victim.ready.pop_back();
+      victim.readyCount.store(victim.ready.size(), std::memory_order_relaxed);
+      self.steals.store(self.steals.load() + 1, std::memory_order_relaxed);
+      return account;
+    }
+  }
+  return nullptr;
+}
+
+void BrokerExecutor::RunTurn(Worker &worker, AccountState &account) {
+  // Once the last batch is done, take everything submitted since at once.
+  if (account.next == account.batch.size()) {
+    account.batch.clear();
+    account.next = 0;
+    std::lock_guard<std::mutex> lock(account.mutex);
+    account.batch.swap(account.incoming);
+  }
+
+  // Only this thread writes the counters, so they need no read-modify-write.
+  size_t start = account.next;
+  size_t end = std::min(account.batch.size(), start + TurnLimit);
+  uint64_t fills = 0;
+  uint64_t shares = 0;
+  for (; account.next < end; account.next++) {
+    Request &request = account.batch[account.next];
+    uint32_t filled = account.client.SubmitOrder(request.order);
+    fills += filled != 0;
+    shares += filled;
+    if (request.callback) {
+      request.callback(filled);
+    }
+  }
+  worker.orders.store(worker.orders.load() + (end - start),
+                      std::memory_order_relaxed);
+  worker.fills.store(worker.fills.load() + fills, std::memory_order_relaxed);
+  worker.shares.store(worker.shares.load() + shares,
+                      std::memory_order_relaxed);
+
+  /*
+   * Go to the back of the queue if there is more to do, so the accounts
+   * behind us get a turn, or a thief. Otherwise the chain goes idle, and the
+   * next order submitted schedules it again. An idle chain drops its spent
+   * batch first, so the callbacks (and the promises they hold) are freed
+   * now rather than whenever the account next gets an order.
+   */
+  bool more = account.next < account.batch.size();
+  if (!more) {
+    account.batch.clear();
+    account.next = 0;
+    std::lock_guard<std::mutex> lock(account.mutex);
+    more = !account.incoming.empty();
+    account.scheduled = more;
+  }
+  if (more) {
+    Schedule(worker, &account);
+  }
+}
+
+void BrokerExecutor::Run(size_t index) {
+  uint32_t idlePolls = 0;
+  for (;;) {
+    // As in BrokerEngine, only empty queues seen after stopping end us.
+    bool finished = stopping_.load();
+    for (size_t i = 0; finished && i < workers_.size(); i++) {
+      finished = workers_[i].producers.load() == 0;
+    }
+
+    AccountState *account = Take(index);
+    if (account != nullptr) {
+      RunTurn(workers_[index], *account);
+      idlePolls = 0;
+      continue;
+    }
+    if (finished) {
+      return;
+    }
+
+    // As in BrokerEngine, spin briefly, then yield, then block.
+    idlePolls++;
+    if (idlePolls > WorkerYieldLimit) {
+      idle_.Park([this]() {
+        for (const Worker &worker : workers_) {
+          if (worker.readyCount.load(std::memory_order_relaxed) != 0) {
+            return true;
+          }
+        }
+        return stopping_.load();
+      });
+    } else if (idlePolls > WorkerSpinLimit) {
+      std::this_thread::yield();
+    }
+  }
+}
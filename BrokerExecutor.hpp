@@ -0,0 +1,347 @@
+/**
+ * @file BrokerExecutor.hpp
+ *
+ * Header file describing a BrokerExecutor, which runs many accounts, each a
+ * BrokerClient, on a pool of worker threads that steal work from each other.
+ */
+
+#pragma once
+
+#include "AlignedAllocator.hpp"
+#include "BrokerClient.hpp"
+#include "BrokerEngine.hpp"
+#include "BrokerManager.hpp"
+#include "IdleWaiter.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Struct representing counts of the work done by a BrokerExecutor, or by one
+ * of its workers.
+ */
+typedef struct {
+  /// Number of orders processed for open accounts.
+  uint64_t orders;
+
+  /// Number of orders that bought or sold at least one share.
+  uint64_t fills;
+
+  /// Total number of shares bought or sold.
+  uint64_t shares;
+
+  /// Number of accounts taken from another worker's queue.
+  uint64_t steals;
+} BrokerExecutorStats;
+
+/**
+ * @class BrokerExecutor
+ *
+ * Runs many accounts, each a BrokerClient, on a pool of worker threads that
+ * balance bursts between them by stealing work.
+ *
+ * Each account queues its pending orders in a mailbox, which forms a serial
+ * chain of work. An account with pending orders is scheduled on exactly one
+ * worker's ready queue at a time, starting with the worker its id hashes to.
+ * A worker takes accounts from the front of its own queue and runs a bounded
+ * turn of each one's orders, then puts the account back at the end of its
+ * queue if more are pending. A worker with nothing to do steals an account,
+ * with its whole chain, from the end of another worker's queue. So one
+ * account's burst keeps its worker busy while the other accounts waiting
+ * behind it move to idle workers, and an account's orders still run one at
+ * a time and in order, its client only ever touched by the worker holding
+ * its chain.
+ *
+ * Requests from one thread to one account are processed in the order they
+ * were made. Callbacks run on the worker processing the account, between
+ * orders, so they may read that account's state but must not block.
+ *
+ * A worker that finds every ready queue empty for a while blocks until an
+ * account is scheduled, on any worker, since it could steal that account.
+ * Idle workers therefore use no CPU, at the cost of a fence each time an
+ * account is scheduled and a thread wakeup for the first work after they
+ * have blocked.
+ */
+class BrokerExecutor {
+public:
+  /**
+   * Constructor for the BrokerExecutor, which starts its worker threads.
+   *
+   * @param[in] workerCount
+   *    Number of worker threads, usually one per core.
+   *
+   * @param[in] mailboxCapacity
+   *    Maximum number of orders waiting in each account's mailbox.
+   */
+  BrokerExecutor(size_t workerCount, size_t mailboxCapacity = 1 << 14);
+
+  /// Destructor, which stops every worker as for Stop().
+  ~BrokerExecutor();
+  BrokerExecutor(const BrokerExecutor &) = delete;
+  BrokerExecutor &operator=(const BrokerExecutor &) = delete;
+
+  /**
+   * Open an account, from any thread.
+   *
+   * @param[in] account
+   *    Id of the account.
+   *
+   * @param[in] cashBalance
+   *    The initial amount of cash in the account.
+   *
+   * @retval
+   *    True if the account was opened, false if it already was or the
+   *    executor has been stopped.
+   */
+  bool OpenAccount(AccountId account, double cashBalance);
+
+  /**
+   * Enqueue an order for an account if there is room in its mailbox, from
+   * any thread. Orders for accounts that haven't been opened fill nothing,
+   * and their callback is run straight away on the calling thread.
+   *
+   * @param[in] account
+   *    Id of the account placing the order.
+   *
+   * @param[in] order
+   *    The order to submit.
+   *
+   * @param[in] callback
+   *    Called on a worker thread with the number of shares bought or sold,
+   *    once the order has been processed. May be empty.
+   *
+   * @retval
+   *    True if the order was enqueued, false if the account's mailbox is full
+   *    or the executor has been stopped.
+   */
+  bool TrySubmit(AccountId account, const Order &order, FillCallback callback);
+
+  /**
+   * Enqueue an order for an account, from any thread, waiting for room if
+   * the account's mailbox is full.
+   *
+   * @param[in] account
+   *    Id of the account placing the order.
+   *
+   * @param[in] order
+   *    The order to submit.
+   *
+   * @retval
+   *    A future resolving to the number of shares bought or sold, or to zero
+   *    if the account isn't open or the executor has been stopped.
+   */
+  std::future<uint32_t> Submit(AccountId account, const Order &order);
+
+  /**
+   * Stop accepting orders, wait for every order already enqueued to be
+   * processed, and stop the worker threads. Must not be called from a
+   * callback.
+   */
+  void Stop();
+
+  /// Get the number of worker threads.
+  size_t WorkerCount() const { return workers_.size(); }
+
+  /**
+   * Get the worker an account is scheduled on when orders arrive for it
+   * while it is idle.
+   *
+   * @param[in] account
+   *    Id of the account.
+   *
+   * @retval
+   *    Index of the account's home worker.
+   */
+  size_t HomeOf(AccountId account) const;
+
+  /**
+   * Get an account's client.
+   *
+   * @note
+   *    The client may only be used from callbacks of the account's own
+   *    orders, or once the executor has been stopped.
+   *
+   * @param[in] account
+   *    Id of the account.
+   *
+   * @retval
+   *    The account's client, or null if the account hasn't been opened.
+   */
+  BrokerClient *Account(AccountId account);
+
+  /// Get the number of accounts opened, from any thread.
+  size_t AccountCount() const { return accountCount_.load(); }
+
+  /**
+   * Get the counts of work done by every worker together, from any thread.
+   * Counts are read worker by worker while work continues, so they are only
+   * exact once the executor has been stopped.
+   *
+   * @retval
+   *    The sum of every worker's counts.
+   */
+  BrokerExecutorStats GetStats() const;
+
+  /**
+   * Get the counts of work done by one worker, from any thread.
+   *
+   * @param[in] worker
+   *    Index of the worker, which must be less than WorkerCount().
+   *
+   * @retval
+   *    The worker's counts.
+   */
+  BrokerExecutorStats GetWorkerStats(size_t worker) const;
+
+private:
+  /// Struct representing an order waiting in an account's mailbox.
+  typedef struct {
+    /// The order to process.
+    Order order;
+
+    /// Called with the outcome of the order, unless empty.
+    FillCallback callback;
+  } Request;
+
+  /// Struct holding an account, together with its chain of pending orders.
+  struct AccountState {
+    /// Constructor for an account with an empty mailbox.
+    explicit AccountState(double cashBalance)
+        : scheduled(false), next(0), client(cashBalance) {}
+
+    /// Guards incoming and scheduled, which producers touch.
+    std::mutex mutex;
+
+    /// Orders submitted since the chain last took a batch.
+    std::vector<Request> incoming;
+
+    /// True while the account is on a ready queue or held by a worker.
+    bool scheduled;
+
+    /// Orders being run, only touched by the worker holding the chain.
+    std::vector<Request> batch;
+
+    /// Index of the next order of batch to run.
+    size_t next;
+
+    /// The account's client, only touched by the worker holding the chain.
+    BrokerClient client;
+  };
+
+  /**
+   * Struct holding a worker. Counters are only written by the worker's own
+   * thread, and are atomic only so that other threads may read them.
+   */
+  struct alignas(CacheLineSize) Worker {
+    Worker()
+        : readyCount(0), producers(0), orders(0), fills(0), shares(0),
+          steals(0) {}
+
+    /// Guards ready.
+    std::mutex mutex;
+
+    /**
+     * Accounts with pending orders, taken from the front by the worker and
+     * from the end by thieves.
+     */
+    std::deque<AccountState *> ready;
+
+    /// Size of ready, so that thieves can skip empty queues without locking.
+    std::atomic<size_t> readyCount;
+
+    /// Number of producers currently scheduling onto the worker.
+    std::atomic<uint32_t> producers;
+
+    /// Number of orders processed.
+    std::atomic<uint64_t> orders;
+
+    /// Number of orders that bought or sold at least one share.
+    std::atomic<uint64_t> fills;
+
+    /// Total number of shares bought or sold.
+    std::atomic<uint64_t> shares;
+
+    /// Number of accounts stolen from other workers.
+    std::atomic<uint64_t> steals;
+
+    /// The worker's thread.
+    std::thread thread;
+  };
+
+  /// Struct holding a stripe of the table of accounts.
+  struct alignas(CacheLineSize) AccountStripe {
+    /// Shared for lookups, exclusive for opening accounts.
+    std::shared_timed_mutex mutex;
+
+    /// Accounts on the stripe, which never move once opened.
+    std::unordered_map<AccountId, std::unique_ptr<AccountState>> accounts;
+  };
+
+  /// Maximum number of orders waiting in each account's mailbox.
+  size_t mailboxCapacity_;
+
+  /// Workers, each aligned to a cache line.
+  std::vector<Worker, AlignedAllocator<Worker>> workers_;
+
+  /// Table of accounts, striped by a hash of their id.
+  std::vector<AccountStripe, AlignedAllocator<AccountStripe>> stripes_;
+
+  /// Number of accounts opened.
+  std::atomic<size_t> accountCount_;
+
+  /// Set once the executor stops accepting orders.
+  std::atomic<bool> stopping_;
+
+  /// Blocks workers while every ready queue stays empty.
+  IdleWaiter idle_;
+
+  /// Find an open account from any thread, or return null.
+  AccountState *Find(AccountId account);
+
+  /**
+   * Put an account at the end of a worker's ready queue, and wake a blocked
+   * worker to run or steal it.
+   *
+   * @param[in] worker
+   *    The worker to schedule the account on.
+   *
+   * @param[in] account
+   *    The account, which must not be on any other ready queue.
+   */
+  void Schedule(Worker &worker, AccountState *account);
+
+  /**
+   * Take an account to run, from the front of a worker's own ready queue or
+   * else from the end of another's.
+   *
+   * @param[in] index
+   *    Index of the worker taking an account.
+   *
+   * @retval
+   *    The account, now held by the worker, or null if every queue is empty.
+   */
+  AccountState *Take(size_t index);
+
+  /**
+   * Run a turn of an account's orders on a worker, and put the account back
+   * on the worker's ready queue if more orders are pending.
+   *
+   * @param[in] worker
+   *    The worker holding the account.
+   *
+   * @param[in] account
+   *    The account to run.
+   */
+  void RunTurn(Worker &worker, AccountState &account);
+
+  /// Body of a worker's thread, running accounts until stopped.
+  void Run(size_t index);
+};
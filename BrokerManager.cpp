@@ -0,0 +1,218 @@
+/**
+ * @file BrokerManager.cpp
+ *
+ * File containing the implementation of the BrokerManager.
+ */
+
+#include "BrokerManager.hpp"
+#include <cassert>
+#include <chrono>
+#include <new>
+
+/// Number of empty polls of a queue before its worker starts yielding.
+static const uint32_t ShardSpinLimit = 64;
+
+/// Number of empty polls of a queue before its worker blocks.
+static const uint32_t ShardYieldLimit = 1024;
+
+/// Get a monotonic timestamp in nanoseconds.
+static uint64_t SteadyNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+BrokerManager::BrokerManager(size_t shardCount, size_t queueCapacity)
+    : stopping_(false), startNs_(SteadyNowNs()), stopNs_(0) {
+  assert(shardCount > 0);
+  AlignedAllocator<Shard> allocator;
+  for (size_t i = 0; i < shardCount; i++) {
+    Shard *storage = allocator.allocate(1);
+    shards_.emplace_back(new (storage) Shard(queueCapacity));
+  }
+
+  // Only start the workers once every shard exists.
+  for (auto &shard : shards_) {
+    shard->thread = std::thread(&BrokerManager::Run, this, std::ref(*shard));
+  }
+}
+
+BrokerManager::~BrokerManager() { Stop(); }
+
+size_t BrokerManager::ShardOf(AccountId account) const {
+  return (size_t)(HashAccountId(account) % shards_.size());
+}
+
+bool BrokerManager::TryEnqueue(Request &request) {
+  Shard &shard = *shards_[ShardOf(request.account)];
+
+  // As in BrokerEngine, announce ourselves before checking for a stop.
+  shard.producers.fetch_add(1);
+  if (stopping_.load()) {
+    shard.producers.fetch_sub(1);
+    return false;
+  }
+  bool pushed = shard.queue.TryPush(request);
+  if (pushed) {
+    shard.idle.Notify();
+  }
+  shard.producers.fetch_sub(1);
+  return pushed;
+}
+
+bool BrokerManager::OpenAccount(AccountId account, double cashBalance) {
+  Request request = {.account = account,
+                     .open = true,
+                     .cashBalance = cashBalance,
+                     .order = {},
+                     .callback = FillCallback()};
+  while (!TryEnqueue(request)) {
+    if (stopping_.load()) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+bool BrokerManager::TrySubmit(AccountId account, const Order &order,
+                              FillCallback callback) {
+  Request request = {.account = account,
+                     .open = false,
+                     .cashBalance = 0,
+                     .order = order,
+                     .callback = std::move(callback)};
+  return TryEnqueue(request);
+}
+
+std::future<uint32_t> BrokerManager::Submit(AccountId account,
+                                            const Order &order) {
+  std::shared_ptr<std::promise<uint32_t>> promise =
+      std::make_shared<std::promise<uint32_t>>();
+  std::future<uint32_t> future = promise->get_future();
+  FillCallback callback = [promise](uint32_t filled) {
+    promise->set_value(filled);
+  };
+
+  while (!TrySubmit(account, order, callback)) {
+    if (stopping_.load()) {
+      promise->set_value(0);
+      break;
+    }
+    std::this_thread::yield();
+  }
+  return future;
+}
+
+void BrokerManager::Stop() {
+  stopping_.store(true);
+  for (auto &shard : shards_) {
+    shard->idle.NotifyAll();
+  }
+  for (auto &shard : shards_) {
+    if (shard->thread.joinable()) {
+      shard->thread.join();
+    }
+  }
+
+  // Only the first Stop ends the period the stats cover.
+  uint64_t running = 0;
+  stopNs_.compare_exchange_strong(running, SteadyNowNs());
+}
+
+BrokerClient *BrokerManager::Account(AccountId account) {
+  Shard &shard = *shards_[ShardOf(account)];
+  auto it = shard.accounts.find(account);
+  return it == shard.accounts.end() ? nullptr : &it->second;
+}
+
+BrokerManagerStats BrokerManager::GetStats() const {
+  BrokerManagerStats total = {.accounts = 0,
+                               .orders = 0,
+                               .fills = 0,
+                               .shares = 0,
+                               .elapsedSeconds = ElapsedSeconds()};
+  for (size_t i = 0; i < shards_.size(); i++) {
+    BrokerManagerStats stats = GetShardStats(i);
+    total.accounts += stats.accounts;
+    total.orders += stats.orders;
+    total.fills += stats.fills;
+    total.shares += stats.shares;
+  }
+  return total;
+}
+
+BrokerManagerStats BrokerManager::GetShardStats(size_t shard) const {
+  const Shard &source = *shards_[shard];
+  BrokerManagerStats stats = {
+      .accounts = source.accountCount.load(std::memory_order_relaxed),
+      .orders = source.orders.load(std::memory_order_relaxed),
+      .fills = source.fills.load(std::memory_order_relaxed),
+      .shares = source.shares.load(std::memory_order_relaxed),
+      .elapsedSeconds = ElapsedSeconds()};
+  return stats;
+}
+
+double BrokerManager::ElapsedSeconds() const {
+  uint64_t endNs = stopNs_.load();
+  if (endNs == 0) {
+    endNs = SteadyNowNs();
+  }
+  return (double)(endNs - startNs_) / 1e9;
+}
+
+void BrokerManager::Process(Shard &shard, Request &request) {
+  if (request.open) {
+    if (shard.accounts.find(request.account) == shard.accounts.end()) {
+      shard.accounts.emplace(request.account,
+                             BrokerClient(request.cashBalance));
+      shard.accountCount.store(shard.accountCount.load() + 1,
+                               std::memory_order_relaxed);
+    }
+    return;
+  }
+
+  uint32_t filled = 0;
+  auto it = shard.accounts.find(request.account);
+  if (it != shard.accounts.end()) {
+    filled = it->second.SubmitOrder(request.order);
+  }
+
+  // Only this thread writes the counters, so they need no read-modify-write.
+  shard.orders.store(shard.orders.load() + 1, std::memory_order_relaxed);
+  if (filled != 0) {
+    shard.fills.store(shard.fills.load() + 1, std::memory_order_relaxed);
+    shard.shares.store(shard.shares.load() + filled,
+                       std::memory_order_relaxed);
+  }
+  if (request.callback) {
+    request.callback(filled);
+  }
+}
+
+void BrokerManager::Run(Shard &shard) {
+  Request request;
+  uint32_t idlePolls = 0;
+  for (;;) {
+    // As in BrokerEngine, only an empty queue seen after stopping ends us.
+    bool finished = stopping_.load() && shard.producers.load() == 0;
+
+    if (shard.queue.TryPop(request)) {
+      Process(shard, request);
+      idlePolls = 0;
+      continue;
+    }
+    if (finished) {
+      return;
+    }
+
+    // As in BrokerEngine, spin briefly, then yield, then block.
+    idlePolls++;
+    if (idlePolls > ShardYieldLimit) {
+      shard.idle.Park(
+          [&]() { return !shard.queue.Empty() || stopping_.load(); });
+    } else if (idlePolls > ShardSpinLimit) {
+      std::this_thread::yield();
+    }
+  }
+}
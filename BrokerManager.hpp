@@ -0,0 +1,324 @@
+/**
+ * @file BrokerManager.hpp
+ *
+ * Header file describing a BrokerManager, which owns many accounts, each a
+ * BrokerClient, sharded across worker threads.
+ */
+
+#pragma once
+
+#include "AlignedAllocator.hpp"
+#include "BrokerClient.hpp"
+#include "BrokerEngine.hpp"
+#include "IdleWaiter.hpp"
+#include "MpscQueue.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/// Identifier of an account held by a BrokerManager.
+typedef uint64_t AccountId;
+
+/// Mix the bits of an account id, so that sequential ids spread evenly.
+inline uint64_t HashAccountId(AccountId account) {
+  uint64_t hash = account;
+  hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+  return hash ^ (hash >> 31);
+}
+
+/**
+ * Struct representing counts of the work done by a BrokerManager, or by one
+ * of its shards, and the time taken to do it, from which to derive rates.
+ */
+typedef struct {
+  /// Number of accounts opened.
+  uint64_t accounts;
+
+  /// Number of orders processed, whether or not they were filled.
+  uint64_t orders;
+
+  /// Number of orders that bought or sold at least one share.
+  uint64_t fills;
+
+  /// Total number of shares bought or sold.
+  uint64_t shares;
+
+  /**
+   * Seconds since the manager was constructed, or until it was stopped, over
+   * which the counts were accumulated, e.g. orders / elapsedSeconds gives
+   * the throughput in orders per second.
+   */
+  double elapsedSeconds;
+} BrokerManagerStats;
+
+/**
+ * @class BrokerManager
+ *
+ * Owns many accounts, each a BrokerClient, spread across a fixed number of
+ * shards. Each shard has a worker thread, which alone owns the accounts
+ * assigned to it by a hash of their id, and a lock-free queue through which
+ * any thread routes requests to it. Accounts are therefore only ever
+ * touched by one thread and take no locks, and shards share no mutable
+ * state but the flag telling them to stop, so throughput scales with the
+ * number of shards as long as accounts spread evenly across them.
+ *
+ * Requests from one thread to one account are processed in the order they
+ * were made. Callbacks run on the shard's worker thread, between requests,
+ * so they may read the state of accounts on the same shard but must not
+ * block.
+ *
+ * As in BrokerEngine, a worker whose queue stays empty blocks until a
+ * request arrives, so idle shards use no CPU, at the cost of a fence on
+ * every enqueue and a thread wakeup for a shard's first request after it
+ * has blocked.
+ */
+class BrokerManager {
+public:
+  /**
+   * Constructor for the BrokerManager, which starts a worker thread for
+   * each shard.
+   *
+   * @param[in] shardCount
+   *    Number of shards, usually one per core.
+   *
+   * @param[in] queueCapacity
+   *    Maximum number of requests waiting in each shard's queue, which must
+   *    be a power of two.
+   */
+  BrokerManager(size_t shardCount, size_t queueCapacity = 1 << 14);
+
+  /// Destructor, which stops every shard as for Stop().
+  ~BrokerManager();
+  BrokerManager(const BrokerManager &) = delete;
+  BrokerManager &operator=(const BrokerManager &) = delete;
+
+  /**
+   * Open an account, from any thread, waiting for room in its shard's queue
+   * if it is full. Opening an account that is already open does nothing.
+   *
+   * @param[in] account
+   *    Id of the account.
+   *
+   * @param[in] cashBalance
+   *    The initial amount of cash in the account.
+   *
+   * @retval
+   *    True if the request was enqueued, false if the manager has been
+   *    stopped.
+   */
+  bool OpenAccount(AccountId account, double cashBalance);
+
+  /**
+   * Enqueue an order for an account if there is room, from any thread.
+   * Orders for accounts that haven't been opened fill nothing.
+   *
+   * @param[in] account
+   *    Id of the account placing the order.
+   *
+   * @param[in] order
+   *    The order to submit.
+   *
+   * @param[in] callback
+   *    Called on the shard's worker thread with the number of shares bought
+   *    or sold, once the order has been processed. May be empty.
+   *
+   * @retval
+   *    True if the order was enqueued, false if the shard's queue is full or
+   *    the manager has been stopped.
+   */
+  bool TrySubmit(AccountId account, const Order &order, FillCallback callback);
+
+  /**
+   * Enqueue an order for an account, from any thread, waiting for room if
+   * the shard's queue is full.
+   *
+   * @param[in] account
+   *    Id of the account placing the order.
+   *
+   * @param[in] order
+   *    The order to submit.
+   *
+   * @retval
+   *    A future resolving to the number of shares bought or sold, or to zero
+   *    if the manager has been stopped.
+   */
+  std::future<uint32_t> Submit(AccountId account, const Order &order);
+
+  /**
+   * Stop accepting requests, wait for every request already enqueued to be
+   * processed, and stop the worker threads. Must not be called from a
+   * callback.
+   */
+  void Stop();
+
+  /**
+   * Get the number of shards.
+   *
+   * @retval
+   *    The number of shards, and of worker threads.
+   */
+  size_t ShardCount() const { return shards_.size(); }
+
+  /**
+   * Get the shard an account is assigned to.
+   *
+   * @param[in] account
+   *    Id of the account.
+   *
+   * @retval
+   *    Index of the account's shard.
+   */
+  size_t ShardOf(AccountId account) const;
+
+  /**
+   * Get an account's client.
+   *
+   * @note
+   *    The client is owned by its shard's worker thread. It may only be used
+   *    from callbacks run on that shard, or once the manager has been
+   *    stopped.
+   *
+   * @param[in] account
+   *    Id of the account.
+   *
+   * @retval
+   *    The account's client, or null if the account hasn't been opened.
+   */
+  BrokerClient *Account(AccountId account);
+
+  /**
+   * Get the counts of work done by every shard together, from any thread.
+   * Counts are read shard by shard while work continues, so they are only
+   * exact once the manager has been stopped.
+   *
+   * @retval
+   *    The sum of every shard's counts, and the time elapsed.
+   */
+  BrokerManagerStats GetStats() const;
+
+  /**
+   * Get the counts of work done by one shard, from any thread.
+   *
+   * @param[in] shard
+   *    Index of the shard, which must be less than ShardCount().
+   *
+   * @retval
+   *    The shard's counts, and the time elapsed.
+   */
+  BrokerManagerStats GetShardStats(size_t shard) const;
+
+private:
+  /// Struct representing a request waiting in a shard's queue.
+  typedef struct {
+    /// Id of the account the request is for.
+    AccountId account;
+
+    /// True to open the account, false to submit the order.
+    bool open;
+
+    /// Initial cash balance of an account being opened.
+    double cashBalance;
+
+    /// The order to process.
+    Order order;
+
+    /// Called with the outcome of the order, unless empty.
+    FillCallback callback;
+  } Request;
+
+  /**
+   * Struct holding a shard. Counters are only written by the shard's worker
+   * thread, and are atomic only so that other threads may read them.
+   */
+  struct alignas(CacheLineSize) Shard {
+    /// Constructor for a Shard, with an empty queue of a given capacity.
+    explicit Shard(size_t queueCapacity)
+        : queue(queueCapacity), producers(0), accountCount(0), orders(0),
+          fills(0), shares(0) {}
+
+    /// Requests waiting to be processed.
+    MpscQueue<Request> queue;
+
+    /// Number of producers currently enqueueing, so Stop can wait them out.
+    std::atomic<uint32_t> producers;
+
+    /// Accounts assigned to the shard, only touched by its worker thread.
+    std::unordered_map<AccountId, BrokerClient> accounts;
+
+    /// Number of accounts opened.
+    std::atomic<uint64_t> accountCount;
+
+    /// Number of orders processed.
+    std::atomic<uint64_t> orders;
+
+    /// Number of orders that bought or sold at least one share.
+    std::atomic<uint64_t> fills;
+
+    /// Total number of shares bought or sold.
+    std::atomic<uint64_t> shares;
+
+    /// Blocks the worker thread while the queue stays empty.
+    IdleWaiter idle;
+
+    /// Worker thread draining the queue.
+    std::thread thread;
+  };
+
+  /// Frees a shard allocated with an AlignedAllocator.
+  struct ShardDeleter {
+    void operator()(Shard *shard) const {
+      shard->~Shard();
+      AlignedAllocator<Shard>().deallocate(shard, 1);
+    }
+  };
+
+  /**
+   * Shards, each allocated separately and aligned to a cache line, so that
+   * none share one.
+   */
+  std::vector<std::unique_ptr<Shard, ShardDeleter>> shards_;
+
+  /// Set once the manager stops accepting requests.
+  std::atomic<bool> stopping_;
+
+  /// When the manager was constructed, in steady clock nanoseconds.
+  uint64_t startNs_;
+
+  /// When Stop finished draining the shards, or zero while running.
+  std::atomic<uint64_t> stopNs_;
+
+  /// Get the seconds elapsed from construction until now, or until Stop.
+  double ElapsedSeconds() const;
+
+  /**
+   * Enqueue a request for its account's shard if there is room.
+   *
+   * @param[in] request
+   *    The request, which is moved from only if it was enqueued.
+   *
+   * @retval
+   *    True if the request was enqueued, false if the queue is full or the
+   *    manager has been stopped.
+   */
+  bool TryEnqueue(Request &request);
+
+  /**
+   * Process a request on its shard's worker thread.
+   *
+   * @param[in] shard
+   *    The shard the request was routed to.
+   *
+   * @param[in] request
+   *    The request to process.
+   */
+  void Process(Shard &shard, Request &request);
+
+  /// Body of a shard's worker thread, draining its queue until stopped.
+  void Run(Shard &shard);
+};
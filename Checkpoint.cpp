@@ -0,0 +1,245 @@
+/**
+ * @file Checkpoint.cpp
+ *
+ * File containing the implementation of the checkpoint file helpers.
+ */
+
+#include "Checkpoint.hpp"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Magic bytes identifying a checkpoint file, including its format version.
+static const char CheckpointMagic[8] = {'B', 'R', 'K', 'C', 'K', 'P', 'T', '3'};
+
+#ifdef BROKER_FIXED_POINT
+static const int64_t CheckpointMoneyTicks = MoneyTicksPerUnit;
+#else
+static const int64_t CheckpointMoneyTicks = 0;
+#endif
+
+MappedCheckpoint::~MappedCheckpoint() {
+  if (header_ != nullptr) {
+    munmap(const_cast<CheckpointHeader *>(header_), length_);
+  }
+}
+
+bool MappedCheckpoint::Open(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 ||
+      (size_t)info.st_size < sizeof(CheckpointHeader)) {
+    close(fd);
+    return false;
+  }
+
+  void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  header_ = static_cast<const CheckpointHeader *>(mapping);
+  length_ = info.st_size;
+
+  if (memcmp(header_->magic, CheckpointMagic, sizeof(CheckpointMagic)) != 0 ||
+      header_->moneyTicksPerUnit != CheckpointMoneyTicks) {
+    return false;
+  }
+
+  /*
+   * Check the counts against the space left rather than multiplying them
+   * out, so that corrupt counts can't overflow into a plausible length.
+   */
+  size_t remaining = length_ - sizeof(CheckpointHeader);
+  if (header_->symbolCount > remaining / sizeof(CheckpointSymbol)) {
+    return false;
+  }
+  remaining -= header_->symbolCount * sizeof(CheckpointSymbol);
+  if (header_->lotCount > remaining / sizeof(Lot) ||
+      remaining != header_->lotCount * sizeof(Lot)) {
+    return false;
+  }
+
+  // Every security's lots must lie within the lot array.
+  const CheckpointSymbol *records = Symbols();
+  for (uint64_t i = 0; i < header_->symbolCount; i++) {
+    if (records[i].firstLot > header_->lotCount ||
+        records[i].lotCount > header_->lotCount - records[i].firstLot) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void InitCheckpointHeader(CheckpointHeader *header) {
+  memset(header, 0, sizeof(CheckpointHeader));
+  memcpy(header->magic, CheckpointMagic, sizeof(CheckpointMagic));
+  header->moneyTicksPerUnit = CheckpointMoneyTicks;
+}
+
+std::string CheckpointPath(const std::string &directory, uint64_t sequence) {
+  char name[64];
+  snprintf(name, sizeof(name), "checkpoint-%020" PRIu64 ".bin", sequence);
+  return directory + "/" + name;
+}
+
+bool ListCheckpoints(const std::string &directory,
+                     std::vector<uint64_t> *sequences) {
+  DIR *dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+
+  sequences->clear();
+  while (struct dirent *entry = readdir(dir)) {
+    uint64_t sequence;
+    char suffix[8];
+    if (sscanf(entry->d_name, "checkpoint-%" SCNu64 "%7s", &sequence,
+               suffix) == 2 &&
+        strcmp(suffix, ".bin") == 0) {
+      sequences->push_back(sequence);
+    }
+  }
+  closedir(dir);
+  std::sort(sequences->begin(), sequences->end());
+  return true;
+}
+
+bool FindLatestCheckpoint(const std::string &directory, uint64_t maxSequence,
+                          uint64_t *sequence) {
+  std::vector<uint64_t> sequences;
+  if (!ListCheckpoints(directory, &sequences)) {
+    return false;
+  }
+  auto end = std::upper_bound(sequences.begin(), sequences.end(), maxSequence);
+  if (end == sequences.begin()) {
+    return false;
+  }
+  *sequence = *(end - 1);
+  return true;
+}
+
+bool WriteFileAtomically(const std::string &path, const void *data,
+                         size_t size) {
+  std::string temporaryPath = path + ".tmp";
+  int fd = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  const char *remaining = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t written = write(fd, remaining, size);
+    if (written <= 0) {
+      close(fd);
+      unlink(temporaryPath.c_str());
+      return false;
+    }
+    remaining += written;
+    size -= written;
+  }
+
+  bool synced = fsync(fd) == 0;
+  if (close(fd) != 0 || !synced) {
+    unlink(temporaryPath.c_str());
+    return false;
+  }
+  return rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+/**
+ * Delete every checkpoint in a directory older than the newest one before a
+ * given checkpoint. Checkpoints later than it are left alone.
+ *
+ * @param[in] directory
+ *    Directory holding the checkpoints.
+ *
+ * @param[in] sequence
+ *    Sequence number of the checkpoint just written.
+ */
+static void RemoveStaleCheckpoints(const std::string &directory,
+                                   uint64_t sequence) {
+  std::vector<uint64_t> sequences;
+  if (!ListCheckpoints(directory, &sequences)) {
+    return;
+  }
+  size_t kept = std::upper_bound(sequences.begin(), sequences.end(), sequence) -
+                sequences.begin();
+  for (size_t i = 0; i + 2 < kept; i++) {
+    unlink(CheckpointPath(directory, sequences[i]).c_str());
+  }
+}
+
+CheckpointWriter::CheckpointWriter() {
+  thread_ = std::thread(&CheckpointWriter::Run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  pending_.notify_one();
+  thread_.join();
+}
+
+void CheckpointWriter::Write(const std::string &directory, uint64_t sequence,
+                             std::vector<char> &contents) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (jobs_.empty()) {
+      jobs_.push_back(Job());
+    }
+    Job &job = jobs_.back();
+    job.directory = directory;
+    job.sequence = sequence;
+    job.contents.swap(contents);
+  }
+  pending_.notify_one();
+}
+
+bool CheckpointWriter::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this]() { return jobs_.empty() && !busy_; });
+  bool succeeded = succeeded_;
+  succeeded_ = true;
+  return succeeded;
+}
+
+void CheckpointWriter::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    pending_.wait(lock, [this]() { return !jobs_.empty() || stopping_; });
+    if (jobs_.empty()) {
+      return;
+    }
+    Job job = std::move(jobs_.front());
+    jobs_.pop_front();
+    busy_ = true;
+
+    // Write without holding the lock, so handing over never waits on disk.
+    lock.unlock();
+    bool written =
+        WriteFileAtomically(CheckpointPath(job.directory, job.sequence),
+                            job.contents.data(), job.contents.size());
+    if (written) {
+      RemoveStaleCheckpoints(job.directory, job.sequence);
+    }
+    lock.lock();
+
+    succeeded_ = succeeded_ && written;
+    busy_ = false;
+    if (jobs_.empty()) {
+      idle_.notify_all();
+    }
+  }
+}
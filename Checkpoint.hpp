@@ -0,0 +1,295 @@
+/**
+ * @file Checkpoint.hpp
+ *
+ * Header file describing the binary layout of portfolio checkpoint files,
+ * and helpers for writing, finding and mapping them.
+ *
+ * A checkpoint is a header followed by two flat arrays, one of per-security
+ * records and one of open lots, so it can be loaded with a single mmap and
+ * read in place without any per-record parsing.
+ */
+
+#pragma once
+
+#include "LotQueue.hpp"
+#include "Money.hpp"
+#include "TransactionJournal.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Struct describing the header at the start of a checkpoint file.
+ */
+typedef struct {
+  /// Identifies the file as a checkpoint, and the version of its format.
+  char magic[8];
+
+  /**
+   * Ticks per unit of currency of the Money values in the file, or zero if
+   * they are doubles. Checkpoints can only be loaded by a build using the
+   * same representation.
+   */
+  int64_t moneyTicksPerUnit;
+
+  /// Number of fills processed by the client when the checkpoint was taken.
+  uint64_t sequence;
+
+  /// Cash balance of the client.
+  Money cashBalance;
+
+  /// Number of CheckpointSymbol records following the header.
+  uint64_t symbolCount;
+
+  /// Number of Lot records following the symbol records.
+  uint64_t lotCount;
+
+  /**
+   * PolicyId of the cost basis policy the lots were kept under. Checkpoints
+   * can only be loaded by a client using the same policy.
+   */
+  uint64_t costBasisPolicy;
+
+  /// Cumulative realized profit or loss of the client, across securities.
+  Money realizedPnL;
+} CheckpointHeader;
+
+/**
+ * Struct describing the state of a single security in a checkpoint. Records
+ * appear in SymbolId order.
+ */
+typedef struct {
+  /// Ticker name of the security, padded with zeros.
+  char name[JournalNameLength];
+
+  /// Quantity of shares of the security held.
+  uint32_t quantity;
+
+  /// Number of open lots of the security.
+  uint32_t lotCount;
+
+  /// Total purchase cost of the shares held.
+  Money totalCost;
+
+  /// Cumulative realized profit or loss of sales of the security.
+  Money realizedPnL;
+
+  /// Index of the security's first lot in the checkpoint's lot array.
+  uint64_t firstLot;
+} CheckpointSymbol;
+
+/**
+ * @class MappedCheckpoint
+ *
+ * A checkpoint file mapped read-only into memory, with its arrays exposed in
+ * place.
+ */
+class MappedCheckpoint {
+public:
+  MappedCheckpoint() {}
+  ~MappedCheckpoint();
+  MappedCheckpoint(const MappedCheckpoint &) = delete;
+  MappedCheckpoint &operator=(const MappedCheckpoint &) = delete;
+
+  /**
+   * Map a checkpoint file and check that it is complete, that every
+   * security's lots lie within it, and that it was written by a build using
+   * the same Money representation.
+   *
+   * @param[in] path
+   *    Path of the checkpoint file.
+   *
+   * @retval
+   *    True if the file was mapped and is a valid checkpoint.
+   */
+  bool Open(const std::string &path);
+
+  /// Get the checkpoint's header.
+  const CheckpointHeader &Header() const { return *header_; }
+
+  /// Get the checkpoint's per-security records.
+  const CheckpointSymbol *Symbols() const {
+    return reinterpret_cast<const CheckpointSymbol *>(header_ + 1);
+  }
+
+  /// Get the checkpoint's open lots.
+  const Lot *Lots() const {
+    return reinterpret_cast<const Lot *>(Symbols() + header_->symbolCount);
+  }
+
+private:
+  /// Start of the mapping, which is the header.
+  const CheckpointHeader *header_ = nullptr;
+
+  /// Length of the mapping.
+  size_t length_ = 0;
+};
+
+/**
+ * Initialize a checkpoint header, filling in the fields that identify the
+ * file format and zeroing the rest.
+ *
+ * @param[out] header
+ *    The header to initialize.
+ */
+void InitCheckpointHeader(CheckpointHeader *header);
+
+/**
+ * Get the path of the checkpoint for a sequence number within a directory.
+ * Names sort in sequence order.
+ *
+ * @param[in] directory
+ *    Directory holding the checkpoints.
+ *
+ * @param[in] sequence
+ *    Sequence number of the checkpoint.
+ *
+ * @retval
+ *    The path of the checkpoint file.
+ */
+std::string CheckpointPath(const std::string &directory, uint64_t sequence);
+
+/**
+ * List the checkpoints in a directory.
+ *
+ * @param[in] directory
+ *    Directory holding the checkpoints.
+ *
+ * @param[out] sequences
+ *    Set to the sequence numbers of the checkpoints found, oldest first.
+ *
+ * @retval
+ *    True if the directory could be read.
+ */
+bool ListCheckpoints(const std::string &directory,
+                     std::vector<uint64_t> *sequences);
+
+/**
+ * Find the newest checkpoint in a directory, no later than a sequence number.
+ *
+ * @param[in] directory
+ *    Directory holding the checkpoints.
+ *
+ * @param[in] maxSequence
+ *    Largest sequence number to consider, e.g. the length of the journal.
+ *
+ * @param[out] sequence
+ *    Set to the sequence number of the checkpoint found.
+ *
+ * @retval
+ *    True if a checkpoint was found.
+ */
+bool FindLatestCheckpoint(const std::string &directory, uint64_t maxSequence,
+                          uint64_t *sequence);
+
+/**
+ * Write a file atomically, by writing and syncing a temporary file then
+ * renaming it into place, so that a crash never leaves a partial file.
+ *
+ * @param[in] path
+ *    Path of the file to write.
+ *
+ * @param[in] data
+ *    Contents of the file.
+ *
+ * @param[in] size
+ *    Length of the contents.
+ *
+ * @retval
+ *    True if the file was written.
+ */
+bool WriteFileAtomically(const std::string &path, const void *data,
+                         size_t size);
+
+/**
+ * @class CheckpointWriter
+ *
+ * Writes checkpoints on a background thread, so that the thread taking them
+ * only pays for copying its state into memory, and never waits for the file
+ * to be written, synced and renamed into place.
+ *
+ * At most one checkpoint waits while another is written: handing over a
+ * newer one replaces it, so a slow disk costs skipped checkpoints rather
+ * than a growing backlog of copies in memory. Once a checkpoint is written,
+ * every checkpoint older than the newest one before it is deleted.
+ */
+class CheckpointWriter {
+public:
+  /// Constructor for the CheckpointWriter, which starts the writer thread.
+  CheckpointWriter();
+
+  /// Destructor, which writes any checkpoints still pending and stops.
+  ~CheckpointWriter();
+  CheckpointWriter(const CheckpointWriter &) = delete;
+  CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+  /**
+   * Hand over a checkpoint to be written atomically, as by
+   * WriteFileAtomically, replacing any checkpoint still waiting.
+   *
+   * @param[in] directory
+   *    Directory holding the checkpoints.
+   *
+   * @param[in] sequence
+   *    Sequence number of the checkpoint, which must increase with every
+   *    call.
+   *
+   * @param[in] contents
+   *    Contents of the checkpoint, which are moved from.
+   */
+  void Write(const std::string &directory, uint64_t sequence,
+             std::vector<char> &contents);
+
+  /**
+   * Wait until every checkpoint handed over so far has been written.
+   *
+   * @retval
+   *    True if every checkpoint written since the last call succeeded.
+   */
+  bool Flush();
+
+private:
+  /// Struct representing a checkpoint waiting to be written.
+  typedef struct {
+    /// Directory holding the checkpoints.
+    std::string directory;
+
+    /// Sequence number of the checkpoint.
+    uint64_t sequence;
+
+    /// Contents of the checkpoint.
+    std::vector<char> contents;
+  } Job;
+
+  /// Guards the rest of the writer's state.
+  std::mutex mutex_;
+
+  /// Signalled when a job is handed over or the writer stops.
+  std::condition_variable pending_;
+
+  /// Signalled when the writer runs out of jobs.
+  std::condition_variable idle_;
+
+  /// Checkpoint waiting to be written, if any; never more than one.
+  std::deque<Job> jobs_;
+
+  /// True while the writer thread is writing a job it has taken.
+  bool busy_ = false;
+
+  /// False once a write has failed, until the next Flush.
+  bool succeeded_ = true;
+
+  /// Set when the writer should stop once every job is written.
+  bool stopping_ = false;
+
+  /// Thread writing the checkpoints.
+  std::thread thread_;
+
+  /// Body of the writer thread, writing jobs until stopped.
+  void Run();
+};
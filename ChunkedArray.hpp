@@ -0,0 +1,118 @@
+/**
+ * @file ChunkedArray.hpp
+ *
+ * Header file describing a ChunkedArray, a growable array whose elements
+ * never move, so that other threads can keep reading them while it grows.
+ */
+
+#pragma once
+
+#include "AlignedAllocator.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <new>
+
+/**
+ * @class ChunkedArray
+ *
+ * Array of default-constructed elements stored in chunks, which are
+ * allocated as the array grows and never moved or freed until it is
+ * destroyed. A table of chunk pointers of fixed size means indexing never
+ * has to read anything the growing thread might be rewriting, so one thread
+ * may grow the array while others index into the part already grown.
+ *
+ * Each chunk is twice the size of the one before, so a small array costs
+ * little memory, a large one needs few chunks, and the chunk holding an
+ * index is found from its highest set bit.
+ *
+ * @note
+ *    Only one thread at a time may call Grow. Other threads may only index
+ *    elements they have learned exist through some synchronization with the
+ *    thread that grew the array.
+ */
+template <typename T> class ChunkedArray {
+public:
+  /// Log2 of the number of elements in the first chunk.
+  static const size_t FirstChunkBits = 4;
+
+  /// Number of elements in the first chunk.
+  static const size_t FirstChunkSize = (size_t)1 << FirstChunkBits;
+
+  /// Maximum number of chunks, which bounds the size of the array.
+  static const size_t MaxChunks = 24;
+
+  /// Maximum number of elements, held by MaxChunks chunks.
+  static const size_t MaxSize = FirstChunkSize * (((size_t)1 << MaxChunks) - 1);
+
+  ChunkedArray() {
+    for (std::atomic<T *> &chunk : chunks_) {
+      chunk.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~ChunkedArray() {
+    AlignedAllocator<T> allocator;
+    for (size_t i = 0; i < chunkCount_; i++) {
+      T *elements = chunks_[i].load(std::memory_order_relaxed);
+      for (size_t j = 0; j < FirstChunkSize << i; j++) {
+        elements[j].~T();
+      }
+      allocator.deallocate(elements, FirstChunkSize << i);
+    }
+  }
+
+  ChunkedArray(const ChunkedArray &) = delete;
+  ChunkedArray &operator=(const ChunkedArray &) = delete;
+
+  /**
+   * Ensure the array holds at least a number of elements, allocating chunks
+   * as necessary.
+   *
+   * @param[in] size
+   *    The number of elements required.
+   *
+   * @retval
+   *    True if the array is large enough, false if it would need more than
+   *    MaxSize elements.
+   */
+  bool Grow(size_t size) {
+    if (size > MaxSize) {
+      return false;
+    }
+    AlignedAllocator<T> allocator;
+    while (capacity_ < size) {
+      size_t chunkSize = FirstChunkSize << chunkCount_;
+      T *elements = allocator.allocate(chunkSize);
+      for (size_t j = 0; j < chunkSize; j++) {
+        new (&elements[j]) T();
+      }
+      chunks_[chunkCount_++].store(elements, std::memory_order_release);
+      capacity_ += chunkSize;
+    }
+    return true;
+  }
+
+  /// Get the element at an index, which must be within the grown array.
+  T &operator[](size_t index) const {
+    /*
+     * Chunks 0 to k - 1 hold FirstChunkSize * (2^k - 1) elements, so offset
+     * by FirstChunkSize, the index's chunk is given by its highest set bit.
+     */
+    size_t offset = index + FirstChunkSize;
+    size_t chunk = 63 - __builtin_clzll(offset) - FirstChunkBits;
+    T *elements = chunks_[chunk].load(std::memory_order_acquire);
+    assert(elements != nullptr);
+    return elements[offset - (FirstChunkSize << chunk)];
+  }
+
+private:
+  /// Chunks of elements, of which the first chunkCount_ are allocated.
+  std::atomic<T *> chunks_[MaxChunks];
+
+  /// Number of chunks allocated, only used by the growing thread.
+  size_t chunkCount_ = 0;
+
+  /// Number of elements in the allocated chunks, only used by the grower.
+  size_t capacity_ = 0;
+};
@@ -0,0 +1,222 @@
+/**
+ * @file ConcurrentBrokerClient.cpp
+ *
+ * File containing the implementation of the ConcurrentBrokerClient interface.
+ */
+
+#include "ConcurrentBrokerClient.hpp"
+#include <algorithm>
+#include <cassert>
+
+/**
+ * Add to an atomic amount of money, which the compare-and-swap retries
+ * against whatever other threads have added in the meantime.
+ *
+ * @param[in] total
+ *    The amount to add to.
+ *
+ * @param[in] amount
+ *    Amount to add, which may be negative.
+ */
+static void AtomicAdd(std::atomic<Money> &total, Money amount) {
+  Money current = total.load(std::memory_order_relaxed);
+  while (!total.compare_exchange_weak(current, current + amount)) {
+  }
+}
+
+ConcurrentBrokerClient::ConcurrentBrokerClient(double cashBalance)
+    : cashBalance_(ToMoney(cashBalance)), realizedPnL_(0), sequence_(0),
+      stripes_(StripeCount) {}
+
+SymbolId ConcurrentBrokerClient::InternSymbol(Ticker name) {
+  if (!name.Valid()) {
+    return InvalidSymbolId;
+  }
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(symbolsMutex_);
+    SymbolId symbol = symbols_.Find(name);
+    if (symbol != InvalidSymbolId) {
+      return symbol;
+    }
+  }
+
+  // Not seen before, so take the table exclusively and check again.
+  std::unique_lock<std::shared_timed_mutex> lock(symbolsMutex_);
+  SymbolId symbol = symbols_.Find(name);
+  if (symbol != InvalidSymbolId) {
+    return symbol;
+  }
+  symbol = (SymbolId)symbols_.Size();
+  if (!entries_.Grow((size_t)symbol + 1)) {
+    return InvalidSymbolId;
+  }
+
+  // Name the entry before the id can be seen by anyone else.
+  Entry(symbol).name = name;
+  symbols_.Intern(name);
+  return symbol;
+}
+
+uint32_t ConcurrentBrokerClient::SubmitOrder(const Order &order) {
+  /*
+   * As in BrokerClient, only buys may introduce a new security, since
+   * selling one we haven't seen can never succeed.
+   */
+  SymbolId symbol;
+  if (order.kind == Buy) {
+    symbol = InternSymbol(order.position.name);
+  } else {
+    std::shared_lock<std::shared_timed_mutex> lock(symbolsMutex_);
+    symbol = symbols_.Find(order.position.name);
+  }
+  if (symbol == InvalidSymbolId) {
+    return 0;
+  }
+
+  return SubmitOrder(order.kind, symbol, order.position.quantity,
+                     order.position.price);
+}
+
+uint32_t ConcurrentBrokerClient::SubmitOrder(OrderKind kind, SymbolId symbol,
+                                             uint32_t quantity,
+                                             double price) {
+  assert(symbol != InvalidSymbolId);
+  Money tickPrice = ToMoney(price);
+  price = FromMoney(tickPrice);
+  SymbolEntry &entry = Entry(symbol);
+  Stripe &stripe = StripeOf(symbol);
+  uint32_t quantityTransacted = 0;
+
+  switch (kind) {
+  case Buy: {
+    /*
+     * Reserve the cost of the shares before taking the stripe. The
+     * compare-and-swap only succeeds if the balance hasn't changed since we
+     * sized the order against it, so concurrent buys can never overdraw it
+     * between them; on failure we size the order again against the new
+     * balance.
+     */
+    Money cash = cashBalance_.load(std::memory_order_relaxed);
+    do {
+      quantityTransacted = AffordableQuantity(cash, tickPrice, quantity);
+      if (quantityTransacted == 0) {
+        return 0;
+      }
+    } while (!cashBalance_.compare_exchange_weak(
+        cash, cash - tickPrice * quantityTransacted));
+
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    entry.state.Buy(quantityTransacted, tickPrice);
+    RecordFill(stripe, Buy, entry.name, quantityTransacted, price);
+    break;
+  }
+  case Sell: {
+    Money realized;
+    {
+      // Don't sell shares we don't have.
+      std::lock_guard<std::mutex> lock(stripe.mutex);
+      quantityTransacted = std::min(quantity, entry.state.quantity);
+      if (quantityTransacted == 0) {
+        return 0;
+      }
+      realized = entry.state.Sell(quantityTransacted, tickPrice);
+      RecordFill(stripe, Sell, entry.name, quantityTransacted, price);
+    }
+
+    // The proceeds only become available once the shares are gone.
+    AtomicAdd(cashBalance_, tickPrice * quantityTransacted);
+    AtomicAdd(realizedPnL_, realized);
+    break;
+  }
+  }
+  return quantityTransacted;
+}
+
+void ConcurrentBrokerClient::RecordFill(Stripe &stripe, OrderKind kind,
+                                        Ticker name, uint32_t quantity,
+                                        double price) {
+  /*
+   * Sequence numbers are taken while holding the stripe, so each stripe's
+   * history is in sequence order and can be merged with the others.
+   */
+  SequencedOrder record = {.sequence = sequence_.fetch_add(1),
+                           .order = {.kind = kind,
+                                     .position = {.name = name,
+                                                  .quantity = quantity,
+                                                  .price = price}}};
+  stripe.history.push_back(record);
+}
+
+std::vector<SecurityPosition> ConcurrentBrokerClient::GetPositions() const {
+  size_t count;
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(symbolsMutex_);
+    count = symbols_.Size();
+  }
+
+  std::vector<SecurityPosition> positions;
+  for (SymbolId symbol = 0; symbol < count; symbol++) {
+    SecurityPosition position = GetPosition(symbol);
+    if (position.quantity != 0) {
+      positions.push_back(position);
+    }
+  }
+  return positions;
+}
+
+SecurityPosition ConcurrentBrokerClient::GetPosition(SymbolId symbol) const {
+  const SymbolEntry &entry = Entry(symbol);
+  uint32_t quantity;
+  Money totalCost;
+  {
+    std::lock_guard<std::mutex> lock(StripeOf(symbol).mutex);
+    quantity = entry.state.quantity;
+    totalCost = entry.state.totalCost;
+  }
+
+  SecurityPosition position = {
+      .name = entry.name, .quantity = quantity, .price = 0};
+  if (quantity != 0) {
+    position.price = AveragePrice(totalCost, quantity);
+  }
+  return position;
+}
+
+double ConcurrentBrokerClient::GetRealizedPnL(SymbolId symbol) const {
+  std::lock_guard<std::mutex> lock(StripeOf(symbol).mutex);
+  return FromMoney(Entry(symbol).state.realizedPnL);
+}
+
+SecurityPosition ConcurrentBrokerClient::GetPosition(Ticker name) const {
+  SymbolId symbol;
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(symbolsMutex_);
+    symbol = symbols_.Find(name);
+  }
+  if (symbol == InvalidSymbolId) {
+    SecurityPosition position = {.name = name, .quantity = 0, .price = 0};
+    return position;
+  }
+  return GetPosition(symbol);
+}
+
+std::vector<Order> ConcurrentBrokerClient::GetTransactions() const {
+  // Gather every stripe's history, then merge them back into sequence order.
+  std::vector<SequencedOrder> records;
+  for (Stripe &stripe : stripes_) {
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    records.insert(records.end(), stripe.history.begin(),
+                   stripe.history.end());
+  }
+  std::sort(records.begin(), records.end(),
+            [](const SequencedOrder &a, const SequencedOrder &b) {
+              return a.sequence < b.sequence;
+            });
+
+  std::vector<Order> transactions;
+  transactions.reserve(records.size());
+  for (const SequencedOrder &record : records) {
+    transactions.push_back(record.order);
+  }
+  return transactions;
+}
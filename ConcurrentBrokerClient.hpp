@@ -0,0 +1,300 @@
+/**
+ * @file ConcurrentBrokerClient.hpp
+ *
+ * Header file describing ConcurrentBrokerClient, a thread-safe variant of
+ * BrokerClient in which orders for different securities are processed in
+ * parallel.
+ */
+
+#pragma once
+
+#include "AlignedAllocator.hpp"
+#include "BrokerClient.hpp"
+#include "ChunkedArray.hpp"
+#include "Money.hpp"
+#include "SymbolTable.hpp"
+#include "Ticker.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+/**
+ * @class ConcurrentBrokerClient
+ *
+ * Thread-safe interface for buying and selling securities, with the same
+ * semantics as BrokerClient. Every method may be called from any thread.
+ *
+ * Rather than one lock around the whole client, securities are hashed by id
+ * onto a fixed set of lock stripes, so orders for securities on different
+ * stripes never contend. The cash balance is shared by every security, so it
+ * is kept in an atomic and buys reserve their cost with a compare-and-swap
+ * before touching the position, which keeps the no-overdraft guarantee
+ * without a lock.
+ *
+ * Per-security state lives in chunks that never move once allocated, so it
+ * can be reached by id without locking the symbol table.
+ *
+ * @note
+ *    Journaling and checkpoints are not supported by this variant.
+ */
+class ConcurrentBrokerClient {
+public:
+  /**
+   * Constructor for the ConcurrentBrokerClient.
+   *
+   * @param[in] cashBalance
+   *    The initial amount of cash that the client will be instantiated with.
+   */
+  ConcurrentBrokerClient(double cashBalance);
+  ConcurrentBrokerClient(const ConcurrentBrokerClient &) = delete;
+  ConcurrentBrokerClient &operator=(const ConcurrentBrokerClient &) = delete;
+
+  /**
+   * Submit an order to buy or sell a given security, as for
+   * BrokerClient::SubmitOrder.
+   *
+   * @param[in] order
+   *    An Order object representing the necessary details to process the
+   *    transaction.
+   *
+   * @retval
+   *    The number of shares that were bought or sold as part of the order.
+   */
+  uint32_t SubmitOrder(const Order &order);
+
+  /**
+   * Submit an order to buy or sell a security identified by its SymbolId,
+   * as for BrokerClient::SubmitOrder. This path takes no lock other than the
+   * security's stripe.
+   *
+   * @param[in] kind
+   *    Type of the order.
+   *
+   * @param[in] symbol
+   *    Id of the security, as returned by InternSymbol.
+   *
+   * @param[in] quantity
+   *    Quantity of shares to buy or sell.
+   *
+   * @param[in] price
+   *    Price per share at which to buy or sell.
+   *
+   * @retval
+   *    The number of shares that were bought or sold as part of the order.
+   */
+  uint32_t SubmitOrder(OrderKind kind, SymbolId symbol, uint32_t quantity,
+                       double price);
+
+  /**
+   * Get the SymbolId for a ticker name, assigning a new id if the name has
+   * not been seen before. Ids are stable for the lifetime of the client.
+   *
+   * @param[in] name
+   *    Ticker name of the security.
+   *
+   * @retval
+   *    The id to use with the id-based SubmitOrder overload, or
+   *    InvalidSymbolId if the name is longer than Ticker::MaxLength or the
+   *    client cannot hold any more securities.
+   */
+  SymbolId InternSymbol(Ticker name);
+
+  /**
+   * Get the ticker name for a SymbolId previously returned by InternSymbol.
+   *
+   * @param[in] symbol
+   *    Id of the security.
+   *
+   * @retval
+   *    The ticker name of the security.
+   */
+  Ticker GetSymbolName(SymbolId symbol) const { return Entry(symbol).name; }
+
+  /**
+   * Get the current outstanding positions of the client, as for
+   * BrokerClient::GetPositions.
+   *
+   * @note
+   *    Each position is read consistently, but securities are read one at a
+   *    time, so orders processed concurrently with the call may be reflected
+   *    in some positions and not others.
+   *
+   * @retval
+   *    A vector of SecurityPosition objects representing the client's
+   *    current portfolio.
+   */
+  std::vector<SecurityPosition> GetPositions() const;
+
+  /**
+   * Get the client's current position in a single security.
+   *
+   * @param[in] symbol
+   *    Id of the security, as returned by InternSymbol.
+   *
+   * @retval
+   *    The client's position in the security, with a quantity and price of
+   *    zero if no shares are held.
+   */
+  SecurityPosition GetPosition(SymbolId symbol) const;
+
+  /**
+   * Get the client's current position in a single security, by name.
+   *
+   * @param[in] name
+   *    Ticker name of the security.
+   *
+   * @retval
+   *    The client's position in the security, with a quantity and price of
+   *    zero if no shares are held.
+   */
+  SecurityPosition GetPosition(Ticker name) const;
+
+  /**
+   * Get a copy of the orders that were successfully processed, in the order
+   * they were processed.
+   *
+   * @note
+   *    Orders processed concurrently with the call may be missing from the
+   *    result.
+   *
+   * @retval
+   *    A vector of Order objects representing transactions processed on
+   *    behalf of the client.
+   */
+  std::vector<Order> GetTransactions() const;
+
+  /**
+   * Get the number of transactions processed on behalf of the client.
+   *
+   * @retval
+   *    The length of the transaction history.
+   */
+  size_t GetTransactionCount() const { return sequence_.load(); }
+
+  /**
+   * Get the client's current cash balance.
+   *
+   * @retval
+   *    The client's current cash balance.
+   */
+  double GetCashBalance() const { return FromMoney(cashBalance_.load()); }
+
+  /**
+   * Get the cumulative realized profit or loss of every sale of a security,
+   * in O(1).
+   *
+   * @param[in] symbol
+   *    Id of the security, as returned by InternSymbol.
+   *
+   * @retval
+   *    The proceeds of every sale of the security less the cost of the
+   *    shares sold, or zero if none have been.
+   */
+  double GetRealizedPnL(SymbolId symbol) const;
+
+  /**
+   * Get the cumulative realized profit or loss of every sale in the
+   * account, across all securities, in O(1).
+   *
+   * @retval
+   *    The proceeds of every sale less the cost of the shares sold.
+   */
+  double GetRealizedPnL() const { return FromMoney(realizedPnL_.load()); }
+
+private:
+  /// Number of lock stripes securities are spread across.
+  static const size_t StripeCount = 64;
+
+  /**
+   * Struct holding everything kept for a single security. The name is set
+   * before the id is handed out and never changes, so it can be read without
+   * locking; the state is guarded by the security's stripe.
+   */
+  struct SymbolEntry {
+    /// Ticker name of the security.
+    Ticker name;
+
+    /// Position and open lots of the security.
+    SymbolState state;
+  };
+
+  /// Struct recording a processed order, tagged with its place in the history.
+  typedef struct {
+    /// Index of the order in the overall history.
+    uint64_t sequence;
+
+    /// The order as it was processed.
+    Order order;
+  } SequencedOrder;
+
+  /**
+   * Struct holding a lock stripe, together with the history of the orders
+   * processed under it. Stripes are cache-line aligned so that threads
+   * working on different stripes never share a line.
+   */
+  struct alignas(CacheLineSize) Stripe {
+    /// Lock guarding the state of every security on the stripe.
+    std::mutex mutex;
+
+    /// Orders processed under the stripe, in increasing sequence order.
+    std::vector<SequencedOrder> history;
+  };
+
+  /// Cash balance, reserved and credited atomically.
+  std::atomic<Money> cashBalance_;
+
+  /// Realized profit or loss across every security, added to atomically.
+  std::atomic<Money> realizedPnL_;
+
+  /// Number of orders processed, which is also the next sequence number.
+  std::atomic<uint64_t> sequence_;
+
+  /// Guards symbols_ and the growth of entries_.
+  mutable std::shared_timed_mutex symbolsMutex_;
+
+  /// Interns security names into SymbolIds, for the by-name interface.
+  SymbolTable symbols_;
+
+  /**
+   * Per-security entries, indexed by SymbolId. An entry is allocated before
+   * its id is handed out, and never moves afterwards.
+   */
+  ChunkedArray<SymbolEntry> entries_;
+
+  /// Lock stripes, indexed by SymbolId % StripeCount.
+  mutable std::vector<Stripe, AlignedAllocator<Stripe>> stripes_;
+
+  /// Get the entry for a security.
+  SymbolEntry &Entry(SymbolId symbol) const { return entries_[symbol]; }
+
+  /// Get the lock stripe for a security.
+  Stripe &StripeOf(SymbolId symbol) const {
+    return stripes_[symbol % StripeCount];
+  }
+
+  /**
+   * Append a fill to a stripe's history, assigning it the next sequence
+   * number. The stripe must be locked.
+   *
+   * @param[in] stripe
+   *    The stripe of the security that was bought or sold.
+   *
+   * @param[in] kind
+   *    Type of the fill.
+   *
+   * @param[in] name
+   *    Ticker name of the security.
+   *
+   * @param[in] quantity
+   *    Quantity of shares bought or sold.
+   *
+   * @param[in] price
+   *    Price per share at which the shares were bought or sold.
+   */
+  void RecordFill(Stripe &stripe, OrderKind kind, Ticker name,
+                  uint32_t quantity, double price);
+
+};
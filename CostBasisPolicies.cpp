@@ -0,0 +1,119 @@
+/**
+ * @file CostBasisPolicies.cpp
+ *
+ * File containing the implementation of the LIFO and HIFO cost basis
+ * policies.
+ */
+
+#include "CostBasisPolicies.hpp"
+#include <algorithm>
+#include <cassert>
+
+void LotStack::Push(const Lot &lot) {
+  Slot slot = {.cumulativeQuantity = lot.quantity,
+               .cumulativeCost = lot.quantity * lot.price,
+               .price = lot.price};
+  if (!slots_.empty()) {
+    slot.cumulativeQuantity += slots_.back().cumulativeQuantity;
+    slot.cumulativeCost += slots_.back().cumulativeCost;
+  }
+  slots_.push_back(slot);
+}
+
+Money LotStack::Consume(uint32_t quantity, uint32_t, Money) {
+  if (quantity == 0) {
+    return 0;
+  }
+  assert(!slots_.empty());
+  const Slot &top = slots_.back();
+  assert(top.cumulativeQuantity >= quantity);
+  uint64_t target = top.cumulativeQuantity - quantity;
+
+  // Binary search for the lowest lot not entirely below the cut point.
+  size_t low = 0;
+  size_t high = slots_.size() - 1;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (slots_[mid].cumulativeQuantity <= target) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  /*
+   * The sale reaches down into (or to the bottom of) the lot we found, so
+   * the running cost at the cut point is that lot's running cost less its
+   * consumed shares.
+   */
+  Slot &cut = slots_[low];
+  Money consumed = (Money)(cut.cumulativeQuantity - target);
+  Money costAtTarget = cut.cumulativeCost - consumed * cut.price;
+  Money valueRemoved = top.cumulativeCost - costAtTarget;
+
+  // Drop every lot above the cut, and the cut lot too if it's used up.
+  uint64_t below = low > 0 ? slots_[low - 1].cumulativeQuantity : 0;
+  if (target == below) {
+    slots_.resize(low);
+  } else {
+    cut.cumulativeQuantity = target;
+    cut.cumulativeCost = costAtTarget;
+    slots_.resize(low + 1);
+  }
+  return valueRemoved;
+}
+
+void LotStack::CopyTo(Lot *lots) const {
+  uint64_t previousQuantity = 0;
+  for (size_t i = 0; i < slots_.size(); i++) {
+    lots[i].quantity =
+        (uint32_t)(slots_[i].cumulativeQuantity - previousQuantity);
+    lots[i].price = slots_[i].price;
+    previousQuantity = slots_[i].cumulativeQuantity;
+  }
+}
+
+void LotStack::Assign(const Lot *lots, size_t count) {
+  slots_.clear();
+  slots_.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    Push(lots[i]);
+  }
+}
+
+/// Order lots by price, so that the heap keeps the most expensive first.
+static bool CheaperLot(const Lot &a, const Lot &b) { return a.price < b.price; }
+
+void LotHeap::Push(const Lot &lot) {
+  lots_.push_back(lot);
+  std::push_heap(lots_.begin(), lots_.end(), CheaperLot);
+}
+
+Money LotHeap::Consume(uint32_t quantity, uint32_t, Money) {
+  Money valueRemoved = 0;
+  while (quantity > 0) {
+    assert(!lots_.empty());
+    Lot &top = lots_.front();
+
+    // A partial sale leaves the lot's price, and so the heap, unchanged.
+    if (top.quantity > quantity) {
+      top.quantity -= quantity;
+      valueRemoved += quantity * top.price;
+      break;
+    }
+    valueRemoved += top.quantity * top.price;
+    quantity -= top.quantity;
+    std::pop_heap(lots_.begin(), lots_.end(), CheaperLot);
+    lots_.pop_back();
+  }
+  return valueRemoved;
+}
+
+void LotHeap::CopyTo(Lot *lots) const {
+  std::copy(lots_.begin(), lots_.end(), lots);
+}
+
+void LotHeap::Assign(const Lot *lots, size_t count) {
+  lots_.assign(lots, lots + count);
+  std::make_heap(lots_.begin(), lots_.end(), CheaperLot);
+}
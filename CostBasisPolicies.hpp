@@ -0,0 +1,262 @@
+/**
+ * @file CostBasisPolicies.hpp
+ *
+ * Header file describing the cost basis policies a BrokerClient can be built
+ * with, which decide which shares a sale takes and so what cost it removes
+ * from a position.
+ *
+ * A policy is a class holding the open lots of one security, chosen as a
+ * template argument so that each client is compiled for its policy, with no
+ * virtual dispatch. Every policy provides:
+ *
+ *  - PolicyId, a static constant identifying it in checkpoints.
+ *  - A constructor taking the MemoryResource its storage comes from.
+ *  - Empty() and Size(), the number of open lots.
+ *  - Push(lot), recording a buy.
+ *  - Consume(quantity, heldQuantity, totalCost), removing sold shares and
+ *    returning their cost. The position's quantity and total cost are passed
+ *    in for policies that don't track lots.
+ *  - CopyTo(lots) and Assign(lots, count), for checkpoints.
+ *  - Reserve(capacity), so buying allocates nothing up to that many lots.
+ *
+ * The policies are:
+ *
+ *  - LotQueue: first in, first out, in LotQueue.hpp.
+ *  - LotStack: last in, first out.
+ *  - LotHeap: highest cost first.
+ *  - AverageCost: every share at the position's average cost, with no lots.
+ */
+
+#pragma once
+
+#include "LotQueue.hpp"
+#include "MemoryResource.hpp"
+#include "Money.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class LotStack
+ *
+ * LIFO stack of lots. Lots are pushed as they are bought and consumed from
+ * the top, newest first, as they are sold.
+ *
+ * As in LotQueue, each slot records the running totals of quantity and cost
+ * from the bottom of the stack through its lot, so a sale finds the lot it
+ * ends in by binary search and drops everything above it at once, and
+ * consuming is O(log n) in the number of open lots.
+ */
+class LotStack {
+public:
+  /// Identifies the policy in checkpoints.
+  static const uint32_t PolicyId = 1;
+
+  /**
+   * Constructor for the LotStack.
+   *
+   * @param[in] resource
+   *    Resource from which the stack is allocated, or null for the default.
+   */
+  explicit LotStack(MemoryResource *resource = nullptr) : slots_(resource) {}
+
+  /// Check whether the stack holds any lots.
+  bool Empty() const { return slots_.empty(); }
+
+  /// Get the number of lots in the stack.
+  size_t Size() const { return slots_.size(); }
+
+  /**
+   * Push a lot onto the top of the stack.
+   *
+   * @param[in] lot
+   *    The lot to push.
+   */
+  void Push(const Lot &lot);
+
+  /**
+   * Consume shares from the top of the stack, newest lot first. Fully
+   * consumed lots are removed and a partially consumed lot keeps its
+   * remainder.
+   *
+   * @note
+   *    The stack must hold at least as many shares as are consumed.
+   *
+   * @param[in] quantity
+   *    The number of shares to consume.
+   *
+   * @retval
+   *    The total purchase cost of the consumed shares.
+   */
+  Money Consume(uint32_t quantity, uint32_t, Money);
+
+  /**
+   * Copy the lots in the stack, oldest first, into an array.
+   *
+   * @param[out] lots
+   *    Pointer to an array of at least Size() elements.
+   */
+  void CopyTo(Lot *lots) const;
+
+  /**
+   * Replace the contents of the stack with an array of lots.
+   *
+   * @param[in] lots
+   *    Pointer to the lots, oldest first.
+   *
+   * @param[in] count
+   *    Number of lots in the array.
+   */
+  void Assign(const Lot *lots, size_t count);
+
+  /// Ensure the stack can hold a number of lots without growing.
+  void Reserve(size_t capacity) { slots_.reserve(capacity); }
+
+private:
+  /// Struct representing a slot of the stack.
+  typedef struct {
+    /// Total quantity of all lots up to and including this one.
+    uint64_t cumulativeQuantity;
+
+    /// Total cost of all lots up to and including this one.
+    Money cumulativeCost;
+
+    /// Price per share of this lot, used when it is partially consumed.
+    Money price;
+  } Slot;
+
+  /// The stack, oldest lot first.
+  std::vector<Slot, PolyAllocator<Slot>> slots_;
+};
+
+/**
+ * @class LotHeap
+ *
+ * Max-heap of lots keyed on price, so that sales consume the most expensive
+ * shares first, realizing the smallest gain. Buying is O(log n), and a sale
+ * is O(log n) for each lot it uses up.
+ */
+class LotHeap {
+public:
+  /// Identifies the policy in checkpoints.
+  static const uint32_t PolicyId = 2;
+
+  /**
+   * Constructor for the LotHeap.
+   *
+   * @param[in] resource
+   *    Resource from which the heap is allocated, or null for the default.
+   */
+  explicit LotHeap(MemoryResource *resource = nullptr) : lots_(resource) {}
+
+  /// Check whether the heap holds any lots.
+  bool Empty() const { return lots_.empty(); }
+
+  /// Get the number of lots in the heap.
+  size_t Size() const { return lots_.size(); }
+
+  /**
+   * Add a lot to the heap.
+   *
+   * @param[in] lot
+   *    The lot to add.
+   */
+  void Push(const Lot &lot);
+
+  /**
+   * Consume shares from the heap, most expensive lot first. Fully consumed
+   * lots are removed and a partially consumed lot keeps its remainder.
+   *
+   * @note
+   *    The heap must hold at least as many shares as are consumed.
+   *
+   * @param[in] quantity
+   *    The number of shares to consume.
+   *
+   * @retval
+   *    The total purchase cost of the consumed shares.
+   */
+  Money Consume(uint32_t quantity, uint32_t, Money);
+
+  /**
+   * Copy the lots in the heap, in no particular order, into an array.
+   *
+   * @param[out] lots
+   *    Pointer to an array of at least Size() elements.
+   */
+  void CopyTo(Lot *lots) const;
+
+  /**
+   * Replace the contents of the heap with an array of lots.
+   *
+   * @param[in] lots
+   *    Pointer to the lots, in any order.
+   *
+   * @param[in] count
+   *    Number of lots in the array.
+   */
+  void Assign(const Lot *lots, size_t count);
+
+  /// Ensure the heap can hold a number of lots without growing.
+  void Reserve(size_t capacity) { lots_.reserve(capacity); }
+
+private:
+  /// The lots, arranged as a heap with the most expensive first.
+  std::vector<Lot, PolyAllocator<Lot>> lots_;
+};
+
+/**
+ * @class AverageCost
+ *
+ * Policy valuing every share sold at the position's average cost, so that no
+ * lots are kept at all: buying does nothing here, and a sale removes its
+ * proportion of the total cost in O(1).
+ */
+class AverageCost {
+public:
+  /// Identifies the policy in checkpoints.
+  static const uint32_t PolicyId = 3;
+
+  /// Constructor for the AverageCost policy, which allocates nothing.
+  explicit AverageCost(MemoryResource * = nullptr) {}
+
+  /// Check whether any lots are held, which they never are.
+  bool Empty() const { return true; }
+
+  /// Get the number of lots held, which is always zero.
+  size_t Size() const { return 0; }
+
+  /// Record a buy, whose cost the position's total already includes.
+  void Push(const Lot &) {}
+
+  /**
+   * Get the cost of shares sold at the position's average cost.
+   *
+   * @param[in] quantity
+   *    The number of shares sold.
+   *
+   * @param[in] heldQuantity
+   *    The number of shares held before the sale, at least quantity.
+   *
+   * @param[in] totalCost
+   *    The total cost of the shares held before the sale.
+   *
+   * @retval
+   *    The cost of the shares sold, which is all of it if every share is.
+   */
+  Money Consume(uint32_t quantity, uint32_t heldQuantity, Money totalCost) {
+    if (quantity == heldQuantity) {
+      return totalCost;
+    }
+    return ProportionalCost(totalCost, quantity, heldQuantity);
+  }
+
+  /// Copy no lots, since none are held.
+  void CopyTo(Lot *) const {}
+
+  /// Restore no lots, since none are held.
+  void Assign(const Lot *, size_t) {}
+
+  /// Reserve nothing, since buying allocates nothing.
+  void Reserve(size_t) {}
+};
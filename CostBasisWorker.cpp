@@ -0,0 +1,177 @@
+/**
+ * @file CostBasisWorker.cpp
+ *
+ * File containing the implementation of the CostBasisWorker, for each cost
+ * basis policy.
+ */
+
+#include "CostBasisWorker.hpp"
+
+/// Maximum number of fills applied between publications.
+static const size_t WorkerBatchLimit = 256;
+
+/// Number of empty polls of the queue before the worker starts yielding.
+static const uint32_t WorkerSpinLimit = 64;
+
+/// Number of empty polls of the queue before the worker blocks.
+static const uint32_t WorkerYieldLimit = 1024;
+
+template <typename Lots>
+CostBasisWorker<Lots>::CostBasisWorker(size_t queueCapacity)
+    : queue_(queueCapacity), publishedVersion_(0), stopping_(false) {
+  thread_ = std::thread(&CostBasisWorker::Run, this);
+}
+
+template <typename Lots> CostBasisWorker<Lots>::~CostBasisWorker() {
+  stopping_.store(true);
+  idle_.NotifyAll();
+  thread_.join();
+}
+
+template <typename Lots>
+void CostBasisWorker<Lots>::Enqueue(OrderKind kind, SymbolId symbol,
+                                    uint32_t quantity, Money price,
+                                    uint64_t version) {
+  Fill fill = {.version = version,
+               .symbol = symbol,
+               .kind = kind,
+               .quantity = quantity,
+               .price = price};
+  for (;;) {
+    /*
+     * If the queue is full, the worker has fills to apply, so is sure to
+     * publish a later version than one read before the push failed.
+     */
+    uint64_t published = publishedVersion_.load(std::memory_order_acquire);
+    if (queue_.TryPush(fill)) {
+      break;
+    }
+    publication_.Park([&]() {
+      return publishedVersion_.load(std::memory_order_acquire) != published;
+    });
+  }
+  enqueuedVersion_ = version;
+  idle_.Notify();
+}
+
+template <typename Lots>
+void CostBasisWorker<Lots>::Flush() {
+  auto flushed = [this]() {
+    return publishedVersion_.load(std::memory_order_acquire) >=
+           enqueuedVersion_;
+  };
+  while (!flushed()) {
+    publication_.Park(flushed);
+  }
+}
+
+template <typename Lots>
+CostBasis CostBasisWorker<Lots>::Get(SymbolId symbol) const {
+  std::lock_guard<std::mutex> lock(publishedMutex_);
+  if (symbol >= published_.size()) {
+    CostBasis basis = {
+        .totalCost = 0, .quantity = 0, .realizedPnL = 0, .version = 0};
+    return basis;
+  }
+  return published_[symbol];
+}
+
+template <typename Lots>
+void CostBasisWorker<Lots>::GetAveragePrices(size_t count,
+                                             double *prices) const {
+  std::lock_guard<std::mutex> lock(publishedMutex_);
+  for (size_t i = 0; i < count; i++) {
+    prices[i] = 0;
+    if (i < published_.size() && published_[i].quantity != 0) {
+      prices[i] = AveragePrice(published_[i].totalCost, published_[i].quantity);
+    }
+  }
+}
+
+template <typename Lots>
+Money CostBasisWorker<Lots>::GetRealizedPnL() const {
+  std::lock_guard<std::mutex> lock(publishedMutex_);
+  return publishedRealizedPnL_;
+}
+
+template <typename Lots>
+void CostBasisWorker<Lots>::Run() {
+  Fill fill;
+  std::vector<SymbolId> touched;
+  uint64_t version = 0;
+  uint32_t idlePolls = 0;
+  for (;;) {
+    /*
+     * As in BrokerEngine, an empty queue only means we're done if we were
+     * already stopping before we polled it.
+     */
+    bool finished = stopping_.load();
+
+    /*
+     * Apply a batch of fills. Each security is noted the first time the
+     * batch touches it, i.e. when its last fill predates the batch.
+     */
+    uint64_t batchStart = version;
+    size_t applied = 0;
+    while (applied < WorkerBatchLimit && queue_.TryPop(fill)) {
+      if (fill.symbol >= states_.size()) {
+        states_.resize(fill.symbol + 1);
+      }
+      BasicSymbolState<Lots> &state = states_[fill.symbol];
+      if (fill.kind == Buy) {
+        state.Buy(fill.quantity, fill.price);
+      } else {
+        realizedPnL_ += state.Sell(fill.quantity, fill.price);
+      }
+      if (state.lastFill <= batchStart) {
+        touched.push_back(fill.symbol);
+      }
+      state.lastFill = fill.version;
+      version = fill.version;
+      applied++;
+    }
+
+    if (applied > 0) {
+      // Publish the new cost basis of everything the batch touched.
+      {
+        std::lock_guard<std::mutex> lock(publishedMutex_);
+        if (published_.size() < states_.size()) {
+          published_.resize(states_.size());
+        }
+        for (SymbolId symbol : touched) {
+          const BasicSymbolState<Lots> &state = states_[symbol];
+          CostBasis basis = {.totalCost = state.totalCost,
+                             .quantity = state.quantity,
+                             .realizedPnL = state.realizedPnL,
+                             .version = state.lastFill};
+          published_[symbol] = basis;
+        }
+        publishedRealizedPnL_ = realizedPnL_;
+      }
+      publishedVersion_.store(version, std::memory_order_release);
+      publication_.NotifyAll();
+      touched.clear();
+      idlePolls = 0;
+      continue;
+    }
+    if (finished) {
+      return;
+    }
+
+    /*
+     * Spin briefly in case more fills are about to arrive, then yield, and
+     * once there's clearly no work, block until Enqueue wakes us.
+     */
+    idlePolls++;
+    if (idlePolls > WorkerYieldLimit) {
+      idle_.Park([this]() { return !queue_.Empty() || stopping_.load(); });
+    } else if (idlePolls > WorkerSpinLimit) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+template class CostBasisWorker<LotQueue>;
+template class CostBasisWorker<LotStack>;
+template class CostBasisWorker<LotHeap>;
+template class CostBasisWorker<AverageCost>;
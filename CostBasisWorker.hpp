@@ -0,0 +1,204 @@
+/**
+ * @file CostBasisWorker.hpp
+ *
+ * Header file describing a CostBasisWorker, which maintains the open lots and
+ * cost basis of a BrokerClient's positions on a background thread.
+ */
+
+#pragma once
+
+#include "AlignedAllocator.hpp"
+#include "BrokerClient.hpp"
+#include "IdleWaiter.hpp"
+#include "Money.hpp"
+#include "MpscQueue.hpp"
+#include "SymbolTable.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Struct representing the cost basis of a position, as last published by a
+ * CostBasisWorker.
+ */
+typedef struct {
+  /// Total purchase cost of the shares held.
+  Money totalCost;
+
+  /// Quantity of shares held, as of the same fill as the cost.
+  uint32_t quantity;
+
+  /// Cumulative realized profit or loss, as of the same fill as the cost.
+  Money realizedPnL;
+
+  /**
+   * Sequence number of the last fill reflected in the cost basis, in the
+   * same numbering as SymbolState::lastFill, or zero if there is none.
+   */
+  uint64_t version;
+} CostBasis;
+
+/**
+ * @class CostBasisWorker
+ *
+ * Applies fills to the lots and cost basis of each security on a background
+ * thread, so that the thread submitting orders never has to consume lots
+ * itself. Fills are handed over through a lock-free queue in the order they
+ * were made, and the resulting cost basis of each security touched is
+ * published in batches, under a lock held only long enough to copy a few
+ * records. With nothing to do, the worker blocks until a fill is queued,
+ * and a producer waiting for room or for a flush blocks until the next
+ * batch is published.
+ *
+ * @tparam Lots
+ *    Cost basis policy of the client the worker serves.
+ */
+template <typename Lots> class CostBasisWorker {
+public:
+  /**
+   * Constructor for the CostBasisWorker, which starts the worker thread.
+   *
+   * @param[in] queueCapacity
+   *    Maximum number of fills waiting to be applied, which must be a power
+   *    of two.
+   */
+  CostBasisWorker(size_t queueCapacity = 1 << 16);
+
+  /// Destructor, which applies any fills still queued and stops the worker.
+  ~CostBasisWorker();
+  CostBasisWorker(const CostBasisWorker &) = delete;
+  CostBasisWorker &operator=(const CostBasisWorker &) = delete;
+
+  /**
+   * Queue a fill to be applied, waiting for room if the queue is full. Must
+   * only be called from one thread at a time.
+   *
+   * @param[in] kind
+   *    Type of the fill.
+   *
+   * @param[in] symbol
+   *    Id of the security bought or sold.
+   *
+   * @param[in] quantity
+   *    Quantity of shares bought or sold.
+   *
+   * @param[in] price
+   *    Price per share at which they were bought or sold.
+   *
+   * @param[in] version
+   *    Sequence number of the fill, which must increase with every call.
+   */
+  void Enqueue(OrderKind kind, SymbolId symbol, uint32_t quantity,
+               Money price, uint64_t version);
+
+  /**
+   * Wait until every fill queued so far has been applied and published.
+   */
+  void Flush();
+
+  /**
+   * Get the most recently published cost basis of a security.
+   *
+   * @param[in] symbol
+   *    Id of the security.
+   *
+   * @retval
+   *    The cost basis of the security, which is all zeros if no fill in it
+   *    has been applied yet.
+   */
+  CostBasis Get(SymbolId symbol) const;
+
+  /**
+   * Get the most recently published average price per share of every
+   * security up to a given id, under a single acquisition of the lock.
+   *
+   * @param[in] count
+   *    Number of securities, from SymbolId 0, to get prices for.
+   *
+   * @param[out] prices
+   *    Array of count elements, into which the average price per share of
+   *    each security is written, or zero if none is held.
+   */
+  void GetAveragePrices(size_t count, double *prices) const;
+
+  /**
+   * Get the cumulative realized profit or loss across every security, as of
+   * the last published batch.
+   *
+   * @retval
+   *    The realized profit or loss, which is zero if no sale has been
+   *    applied yet.
+   */
+  Money GetRealizedPnL() const;
+
+private:
+  /// Struct representing a fill waiting to be applied.
+  typedef struct {
+    /// Sequence number of the fill.
+    uint64_t version;
+
+    /// Id of the security bought or sold.
+    SymbolId symbol;
+
+    /// Type of the fill.
+    OrderKind kind;
+
+    /// Quantity of shares bought or sold.
+    uint32_t quantity;
+
+    /// Price per share at which they were bought or sold.
+    Money price;
+  } Fill;
+
+  /// Fills waiting to be applied.
+  MpscQueue<Fill> queue_;
+
+  /// Sequence number of the last fill queued, only used by the producer.
+  uint64_t enqueuedVersion_ = 0;
+
+  /// Sequence number of the last fill applied and published.
+  std::atomic<uint64_t> publishedVersion_;
+
+  /// Set when the worker should stop once the queue is empty.
+  std::atomic<bool> stopping_;
+
+  /// On which the worker blocks while the queue is empty.
+  IdleWaiter idle_;
+
+  /// On which the producer blocks until the worker publishes a batch.
+  IdleWaiter publication_;
+
+  /**
+   * Lots and cost basis of every security, indexed by SymbolId. Only touched
+   * by the worker thread.
+   */
+  std::vector<BasicSymbolState<Lots>, AlignedAllocator<BasicSymbolState<Lots>>>
+      states_;
+
+  /// Realized profit or loss across every security, for the worker only.
+  Money realizedPnL_ = 0;
+
+  /// Guards published_ and publishedRealizedPnL_.
+  mutable std::mutex publishedMutex_;
+
+  /// Cost basis of every security as of the last batch, indexed by SymbolId.
+  std::vector<CostBasis> published_;
+
+  /// Realized profit or loss across every security as of the last batch.
+  Money publishedRealizedPnL_ = 0;
+
+  /// Thread applying the fills.
+  std::thread thread_;
+
+  /// Body of the worker thread, applying fills until stopped.
+  void Run();
+};
+
+// Instantiated once, in CostBasisWorker.cpp, for each policy.
+extern template class CostBasisWorker<LotQueue>;
+extern template class CostBasisWorker<LotStack>;
+extern template class CostBasisWorker<LotHeap>;
+extern template class CostBasisWorker<AverageCost>;
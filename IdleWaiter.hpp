@@ -0,0 +1,88 @@
+/**
+ * @file IdleWaiter.hpp
+ *
+ * Header file describing an IdleWaiter, on which worker threads with nothing
+ * to do block until a producer hands them more.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @class IdleWaiter
+ *
+ * Lets idle worker threads block instead of polling, without producers
+ * taking a lock on every hand-off.
+ *
+ * A worker that has run out of work calls Park with a check of whether any
+ * has arrived. Park counts the worker as sleeping, runs the check, and only
+ * blocks if it still finds nothing. A producer calls Notify once its work is
+ * visible, which only takes the lock if some worker is counted as sleeping.
+ * A full fence on each side, between the write of one and the read of the
+ * other, means either the worker's check sees the new work or the producer
+ * sees the sleeping worker, so a wakeup is never lost.
+ */
+class IdleWaiter {
+public:
+  IdleWaiter() : sleepers_(0), signals_(0) {}
+  IdleWaiter(const IdleWaiter &) = delete;
+  IdleWaiter &operator=(const IdleWaiter &) = delete;
+
+  /**
+   * Block the calling worker until a producer notifies it, unless there is
+   * already something to do.
+   *
+   * @param[in] ready
+   *    Callable returning true if there is work, or the worker should stop.
+   *    It is called with the waiter's lock held, so must not block.
+   */
+  template <typename Ready> void Park(Ready ready) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    sleepers_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ready()) {
+      uint64_t seen = signals_;
+      wake_.wait(lock, [&]() { return signals_ != seen; });
+    }
+    sleepers_.fetch_sub(1);
+  }
+
+  /// Wake one parked worker, if any, after making work visible to it.
+  void Notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    signals_++;
+    wake_.notify_one();
+  }
+
+  /// Wake every parked worker, e.g. once they have been told to stop.
+  void NotifyAll() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    signals_++;
+    wake_.notify_all();
+  }
+
+private:
+  /// Guards signals_, and is held by a parking worker until it blocks.
+  std::mutex mutex_;
+
+  /// Signalled by Notify and NotifyAll.
+  std::condition_variable wake_;
+
+  /// Number of workers in Park.
+  std::atomic<uint32_t> sleepers_;
+
+  /// Number of notifications, by which parked workers tell they were woken.
+  uint64_t signals_;
+};
@@ -0,0 +1,36 @@
+/**
+ * @file LatencyStats.cpp
+ *
+ * File containing the implementation of the latency summary helpers.
+ */
+
+#include "LatencyStats.hpp"
+#include <algorithm>
+
+/// Get the sample at a percentile of a sorted, non-empty set of samples.
+static uint64_t Percentile(const std::vector<uint64_t> &sorted,
+                           double percentile) {
+  size_t index = (size_t)(percentile / 100 * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+LatencySummary SummarizeLatency(uint64_t ops, uint64_t totalNs,
+                                std::vector<uint64_t> &samples) {
+  LatencySummary summary = {};
+  summary.ops = ops;
+  if (ops > 0) {
+    summary.nsPerOp = (double)totalNs / ops;
+  }
+  if (totalNs > 0) {
+    summary.opsPerSec = ops * 1e9 / totalNs;
+  }
+
+  if (!samples.empty()) {
+    std::sort(samples.begin(), samples.end());
+    summary.p50Ns = Percentile(samples, 50);
+    summary.p99Ns = Percentile(samples, 99);
+    summary.p999Ns = Percentile(samples, 99.9);
+    summary.maxNs = samples.back();
+  }
+  return summary;
+}
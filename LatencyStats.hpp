@@ -0,0 +1,65 @@
+/**
+ * @file LatencyStats.hpp
+ *
+ * Header file describing helpers for summarizing per-operation latency
+ * samples, shared by the benchmark suite and the replay driver.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Struct summarizing the throughput and latency distribution of a run of
+ * operations.
+ */
+typedef struct {
+  /// Number of operations run.
+  uint64_t ops;
+
+  /// Mean wall time per operation, in nanoseconds.
+  double nsPerOp;
+
+  /// Operations completed per second.
+  double opsPerSec;
+
+  /// Median latency of a single operation, in nanoseconds.
+  uint64_t p50Ns;
+
+  /// 99th percentile latency, in nanoseconds.
+  uint64_t p99Ns;
+
+  /// 99.9th percentile latency, in nanoseconds.
+  uint64_t p999Ns;
+
+  /// Maximum latency, in nanoseconds.
+  uint64_t maxNs;
+} LatencySummary;
+
+/// Get a monotonic timestamp in nanoseconds, for timing operations.
+inline uint64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * Summarize a run of operations.
+ *
+ * @param[in] ops
+ *    Number of operations run.
+ *
+ * @param[in] totalNs
+ *    Total wall time taken by the operations, in nanoseconds.
+ *
+ * @param[in,out] samples
+ *    Per-operation latencies in nanoseconds, which may be a subset of the
+ *    operations. These are sorted in place.
+ *
+ * @retval
+ *    The summary of the run.
+ */
+LatencySummary SummarizeLatency(uint64_t ops, uint64_t totalNs,
+                                std::vector<uint64_t> &samples);
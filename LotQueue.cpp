@@ -0,0 +1,134 @@
+/**
+ * @file LotQueue.cpp
+ *
+ * File containing the implementation of the LotQueue.
+ */
+
+#include "LotQueue.hpp"
+#include <cassert>
+
+void LotQueue::Push(const Lot &lot) {
+  if (size_ == slots_.size()) {
+    Reserve(size_ + 1);
+  }
+
+  // Extend the running totals from the newest lot, or from the base if empty.
+  Slot slot = {.cumulativeQuantity = consumedQuantity_,
+               .cumulativeCost = consumedCost_,
+               .price = lot.price};
+  if (size_ > 0) {
+    slot.cumulativeQuantity = At(size_ - 1).cumulativeQuantity;
+    slot.cumulativeCost = At(size_ - 1).cumulativeCost;
+  }
+  slot.cumulativeQuantity += lot.quantity;
+  slot.cumulativeCost += lot.quantity * lot.price;
+
+  At(size_) = slot;
+  size_++;
+}
+
+Money LotQueue::Consume(uint32_t quantity, uint32_t, Money) {
+  if (quantity == 0) {
+    return 0;
+  }
+  assert(size_ > 0);
+  uint64_t target = consumedQuantity_ + quantity;
+
+  // Binary search for the first lot whose running total covers the sale.
+  size_t low = 0;
+  size_t high = size_ - 1;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (At(mid).cumulativeQuantity < target) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  Slot &last = At(low);
+  assert(last.cumulativeQuantity >= target);
+
+  /*
+   * The sale ends inside (or at the end of) the lot we found, so the running
+   * cost at the cut point is that lot's running cost less its unsold shares.
+   */
+  Money unsold = (Money)(last.cumulativeQuantity - target);
+  Money costAtTarget = last.cumulativeCost - unsold * last.price;
+  Money valueRemoved = costAtTarget - consumedCost_;
+
+  // Drop every fully consumed lot in one step.
+  size_t lotsRemoved = last.cumulativeQuantity == target ? low + 1 : low;
+  head_ = (head_ + lotsRemoved) & (slots_.size() - 1);
+  size_ -= lotsRemoved;
+  consumedQuantity_ = target;
+  consumedCost_ = costAtTarget;
+
+  /*
+   * Rebase the running totals so that they don't grow without bound, which
+   * for a double Money would lose the cost of the shares still held to
+   * cancellation when two of them are subtracted. An empty queue is rebased
+   * for free. Otherwise, the totals are rebased once more has been consumed
+   * than is still held, so each O(n) rebase follows the sale of a good part
+   * of what the last one left held.
+   */
+  if (size_ == 0) {
+    head_ = 0;
+    consumedQuantity_ = 0;
+    consumedCost_ = 0;
+  } else if (consumedCost_ > At(size_ - 1).cumulativeCost - consumedCost_) {
+    for (size_t i = 0; i < size_; i++) {
+      At(i).cumulativeQuantity -= consumedQuantity_;
+      At(i).cumulativeCost -= consumedCost_;
+    }
+    consumedQuantity_ = 0;
+    consumedCost_ = 0;
+  }
+  return valueRemoved;
+}
+
+void LotQueue::CopyTo(Lot *lots) const {
+  uint64_t previousQuantity = consumedQuantity_;
+  for (size_t i = 0; i < size_; i++) {
+    const Slot &slot = At(i);
+    lots[i].quantity = (uint32_t)(slot.cumulativeQuantity - previousQuantity);
+    lots[i].price = slot.price;
+    previousQuantity = slot.cumulativeQuantity;
+  }
+}
+
+void LotQueue::Assign(const Lot *lots, size_t count) {
+  head_ = 0;
+  size_ = 0;
+  consumedQuantity_ = 0;
+  consumedCost_ = 0;
+  Reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    Push(lots[i]);
+  }
+}
+
+void LotQueue::Reserve(size_t capacity) {
+  if (capacity <= slots_.size()) {
+    return;
+  }
+
+  size_t newCapacity = slots_.empty() ? 4 : slots_.size();
+  while (newCapacity < capacity) {
+    newCapacity *= 2;
+  }
+
+  /*
+   * Unwrap the ring into the front of the new buffer, rebasing the running
+   * totals on the consumed point while we're copying anyway.
+   */
+  Slots slots(newCapacity, slots_.get_allocator());
+  for (size_t i = 0; i < size_; i++) {
+    slots[i] = At(i);
+    slots[i].cumulativeQuantity -= consumedQuantity_;
+    slots[i].cumulativeCost -= consumedCost_;
+  }
+  slots_.swap(slots);
+  head_ = 0;
+  consumedQuantity_ = 0;
+  consumedCost_ = 0;
+}
@@ -0,0 +1,180 @@
+/**
+ * @file LotQueue.hpp
+ *
+ * Header file describing a LotQueue, a compact FIFO queue of the open buy lots
+ * held for a single security, which is the default cost basis policy.
+ */
+
+#pragma once
+
+#include "MemoryResource.hpp"
+#include "Money.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Struct representing the unsold remainder of a single buy order. The
+ * security is implied by the queue the lot belongs to.
+ */
+typedef struct {
+  /// Quantity of shares remaining in the lot.
+  uint32_t quantity;
+
+  /// Price per share at which the lot was bought.
+  Money price;
+} Lot;
+
+/**
+ * @class LotQueue
+ *
+ * FIFO queue of lots, stored in a growable ring buffer. Lots are appended at
+ * the tail as they are bought and consumed from the head as they are sold.
+ *
+ * Each slot records the running totals of quantity and cost through the end
+ * of its lot, rather than the lot itself. A sale of any size can then find
+ * the lot it ends in by binary search, compute the cost of the shares it
+ * removes as a difference of two running totals, and drop every lot before
+ * that point by advancing the head, so consuming is O(log n) in the number
+ * of open lots.
+ *
+ * This is the FIFO cost basis policy, and the default. The others are
+ * described in CostBasisPolicies.hpp.
+ */
+class LotQueue {
+public:
+  /// Identifies the policy in checkpoints.
+  static const uint32_t PolicyId = 0;
+
+  /**
+   * Constructor for the LotQueue.
+   *
+   * @param[in] resource
+   *    Resource from which the ring buffer is allocated, or null for the
+   *    default.
+   */
+  explicit LotQueue(MemoryResource *resource = nullptr) : slots_(resource) {}
+
+  /**
+   * Check whether the queue holds any lots.
+   *
+   * @retval
+   *    True if the queue holds no lots.
+   */
+  bool Empty() const { return size_ == 0; }
+
+  /**
+   * Get the number of lots in the queue.
+   *
+   * @retval
+   *    The number of lots in the queue.
+   */
+  size_t Size() const { return size_; }
+
+  /**
+   * Append a lot to the tail of the queue, growing the ring buffer if it is
+   * full.
+   *
+   * @param[in] lot
+   *    The lot to append.
+   */
+  void Push(const Lot &lot);
+
+  /**
+   * Consume shares from the head of the queue, oldest lot first. Fully
+   * consumed lots are removed and a partially consumed lot keeps its
+   * remainder.
+   *
+   * @note
+   *    The queue must hold at least as many shares as are consumed.
+   *
+   * @param[in] quantity
+   *    The number of shares to consume.
+   *
+   * @param[in] heldQuantity
+   *    Quantity of shares held, unused since every lot is known.
+   *
+   * @param[in] totalCost
+   *    Total cost of the shares held, likewise unused.
+   *
+   * @retval
+   *    The total purchase cost of the consumed shares.
+   */
+  Money Consume(uint32_t quantity, uint32_t heldQuantity, Money totalCost);
+
+  /**
+   * Copy the lots in the queue, oldest first, into an array.
+   *
+   * @param[out] lots
+   *    Pointer to an array of at least Size() elements.
+   */
+  void CopyTo(Lot *lots) const;
+
+  /**
+   * Replace the contents of the queue with an array of lots.
+   *
+   * @param[in] lots
+   *    Pointer to the lots, oldest first.
+   *
+   * @param[in] count
+   *    Number of lots in the array.
+   */
+  void Assign(const Lot *lots, size_t count);
+
+  /**
+   * Ensure the queue can hold a number of lots without growing.
+   *
+   * @param[in] capacity
+   *    The number of lots to reserve space for.
+   */
+  void Reserve(size_t capacity);
+
+private:
+  /**
+   * Struct representing a slot of the ring buffer. Running totals are
+   * measured from an arbitrary base which is reset whenever the buffer is
+   * emptied or reallocated, or more has been consumed than is still held.
+   */
+  typedef struct {
+    /// Total quantity of all lots up to and including this one.
+    uint64_t cumulativeQuantity;
+
+    /// Total cost of all lots up to and including this one.
+    Money cumulativeCost;
+
+    /// Price per share of this lot, used when it is partially consumed.
+    Money price;
+  } Slot;
+
+  /// Ring buffer storage type.
+  typedef std::vector<Slot, PolyAllocator<Slot>> Slots;
+
+  /// Ring buffer storage. Its size is zero or a power of two.
+  Slots slots_;
+
+  /// Index into slots_ of the oldest lot.
+  size_t head_ = 0;
+
+  /// Number of lots in the queue.
+  size_t size_ = 0;
+
+  /**
+   * Running total quantity at the point up to which shares have been
+   * consumed. This lies within the head lot if it has been partially
+   * consumed, and at its start otherwise.
+   */
+  uint64_t consumedQuantity_ = 0;
+
+  /// Running total cost at the point up to which shares have been consumed.
+  Money consumedCost_ = 0;
+
+  /// Get the slot at a position relative to the head.
+  Slot &At(size_t offset) {
+    return slots_[(head_ + offset) & (slots_.size() - 1)];
+  }
+
+  /// Get the slot at a position relative to the head.
+  const Slot &At(size_t offset) const {
+    return slots_[(head_ + offset) & (slots_.size() - 1)];
+  }
+};
@@ -0,0 +1,96 @@
+/**
+ * @file MemoryResource.cpp
+ *
+ * File containing the implementation of the default MemoryResource and of
+ * the ArenaResource.
+ */
+
+#include "MemoryResource.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <new>
+#include <stdlib.h>
+
+/**
+ * @class HeapResource
+ *
+ * Resource allocating each request from the heap, with posix_memalign for
+ * alignments operator new doesn't guarantee before C++17.
+ */
+class HeapResource : public MemoryResource {
+public:
+  void *Allocate(size_t bytes, size_t alignment) override {
+    if (alignment <= alignof(std::max_align_t)) {
+      return ::operator new(bytes);
+    }
+    void *storage = nullptr;
+    if (posix_memalign(&storage, alignment, bytes) != 0) {
+      throw std::bad_alloc();
+    }
+    return storage;
+  }
+
+  void Deallocate(void *storage, size_t, size_t alignment) override {
+    if (alignment <= alignof(std::max_align_t)) {
+      ::operator delete(storage);
+    } else {
+      free(storage);
+    }
+  }
+};
+
+MemoryResource *DefaultResource() {
+  // Never destroyed, so that it outlives every container using it.
+  static HeapResource *resource = new HeapResource();
+  return resource;
+}
+
+ArenaResource::ArenaResource(size_t blockSize, MemoryResource *upstream)
+    : upstream_(upstream),
+      // A zero size would never grow to fit an allocation.
+      nextBlockSize_(std::max(blockSize, alignof(std::max_align_t))) {}
+
+ArenaResource::~ArenaResource() {
+  for (const Block &block : blocks_) {
+    upstream_->Deallocate(block.storage, block.size, alignof(std::max_align_t));
+  }
+}
+
+void *ArenaResource::Allocate(size_t bytes, size_t alignment) {
+  uintptr_t start = ((uintptr_t)next_ + alignment - 1) & ~(alignment - 1);
+  if (next_ == nullptr || start + bytes > (uintptr_t)end_) {
+    // Start a new block, with room to align the request within it.
+    size_t size = nextBlockSize_;
+    while (size < bytes + alignment) {
+      size *= 2;
+    }
+    char *storage = static_cast<char *>(
+        upstream_->Allocate(size, alignof(std::max_align_t)));
+    Block block = {.storage = storage, .size = size};
+    blocks_.push_back(block);
+    capacity_ += size;
+    nextBlockSize_ = size * 2;
+    next_ = storage;
+    end_ = storage + size;
+    start = ((uintptr_t)next_ + alignment - 1) & ~(alignment - 1);
+  }
+  next_ = (char *)(start + bytes);
+  return (void *)start;
+}
+
+void ArenaResource::Release() {
+  if (blocks_.empty()) {
+    return;
+  }
+  Block largest = blocks_.back();
+  blocks_.pop_back();
+  for (const Block &block : blocks_) {
+    upstream_->Deallocate(block.storage, block.size, alignof(std::max_align_t));
+  }
+  blocks_.clear();
+  blocks_.push_back(largest);
+  capacity_ = largest.size;
+  nextBlockSize_ = largest.size * 2;
+  next_ = largest.storage;
+  end_ = largest.storage + largest.size;
+}
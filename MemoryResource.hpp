@@ -0,0 +1,219 @@
+/**
+ * @file MemoryResource.hpp
+ *
+ * Header file describing MemoryResource, a source of memory that can be
+ * chosen at runtime, along with an arena implementing it and an allocator
+ * through which standard containers draw from one.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @class MemoryResource
+ *
+ * Interface for a source of memory, after C++17's std::pmr::memory_resource,
+ * which isn't available to us. Containers using a PolyAllocator draw from
+ * whichever resource they were given, without their type depending on it.
+ */
+class MemoryResource {
+public:
+  virtual ~MemoryResource() {}
+
+  /**
+   * Allocate storage.
+   *
+   * @param[in] bytes
+   *    Size of the storage in bytes.
+   *
+   * @param[in] alignment
+   *    Required alignment of the storage, which must be a power of two.
+   *
+   * @retval
+   *    Pointer to uninitialized storage. Throws std::bad_alloc on failure.
+   */
+  virtual void *Allocate(size_t bytes, size_t alignment) = 0;
+
+  /**
+   * Release storage previously returned by Allocate.
+   *
+   * @param[in] storage
+   *    Pointer to the storage to release.
+   *
+   * @param[in] bytes
+   *    Size of the storage, as passed to Allocate.
+   *
+   * @param[in] alignment
+   *    Alignment of the storage, as passed to Allocate.
+   */
+  virtual void Deallocate(void *storage, size_t bytes, size_t alignment) = 0;
+};
+
+/**
+ * Get the resource that allocates straight from the heap, which is used
+ * wherever no other resource is given. It is never destroyed and is safe to
+ * use from any thread.
+ *
+ * @retval
+ *    The default resource.
+ */
+MemoryResource *DefaultResource();
+
+/**
+ * @class ArenaResource
+ *
+ * Resource handing out storage from large blocks by bumping a pointer, and
+ * never releasing any of it individually: Deallocate does nothing, and every
+ * block is freed at once when the arena is released or destroyed. Suits
+ * short-lived clients, whose memory can be thrown away wholesale instead of
+ * object by object, and long-lived ones that mostly grow.
+ *
+ * @note
+ *    An arena is not thread-safe. Storage abandoned by a growing container
+ *    is not reused until the arena is released.
+ */
+class ArenaResource : public MemoryResource {
+public:
+  /**
+   * Constructor for the ArenaResource.
+   *
+   * @param[in] blockSize
+   *    Size of the first block in bytes, raised to at least the fundamental
+   *    alignment. Each later block is twice the size of the one before, or
+   *    larger if needed for a single allocation.
+   *
+   * @param[in] upstream
+   *    Resource from which blocks are allocated.
+   */
+  explicit ArenaResource(size_t blockSize = 64 * 1024,
+                         MemoryResource *upstream = DefaultResource());
+  ~ArenaResource();
+  ArenaResource(const ArenaResource &) = delete;
+  ArenaResource &operator=(const ArenaResource &) = delete;
+
+  void *Allocate(size_t bytes, size_t alignment) override;
+  void Deallocate(void *, size_t, size_t) override {}
+
+  /**
+   * Free everything allocated from the arena at once. The largest block is
+   * kept and reused, so an arena released between clients of similar size
+   * settles into allocating nothing from upstream at all.
+   *
+   * @note
+   *    Nothing allocated from the arena may be used afterwards.
+   */
+  void Release();
+
+  /**
+   * Get the total size of the blocks the arena holds.
+   *
+   * @retval
+   *    The number of bytes allocated from upstream and not yet freed.
+   */
+  size_t Capacity() const { return capacity_; }
+
+private:
+  /// Struct representing a block allocated from upstream.
+  typedef struct {
+    /// Start of the block.
+    char *storage;
+
+    /// Size of the block in bytes.
+    size_t size;
+  } Block;
+
+  /// Resource from which blocks are allocated.
+  MemoryResource *upstream_;
+
+  /// Blocks allocated, the newest and largest last.
+  std::vector<Block> blocks_;
+
+  /// Size of the next block to allocate.
+  size_t nextBlockSize_;
+
+  /// Total size of the blocks in blocks_.
+  size_t capacity_ = 0;
+
+  /// Next free byte of the newest block.
+  char *next_ = nullptr;
+
+  /// End of the newest block.
+  char *end_ = nullptr;
+};
+
+/**
+ * @class PolyAllocator
+ *
+ * Standard-conforming allocator drawing from a MemoryResource, so that
+ * containers of the same type can use different resources. Storage is
+ * aligned to at least alignof(T), so it also serves over-aligned types.
+ */
+template <typename T> class PolyAllocator {
+public:
+  typedef T value_type;
+
+  /*
+   * A container moved into another takes its storage and resource along,
+   * rather than moving element by element, so nothing that points into it
+   * is left dangling.
+   */
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  PolyAllocator() : resource_(DefaultResource()) {}
+
+  /// Constructor drawing from a resource, or from the default if null.
+  PolyAllocator(MemoryResource *resource)
+      : resource_(resource ? resource : DefaultResource()) {}
+
+  template <typename U>
+  PolyAllocator(const PolyAllocator<U> &other)
+      : resource_(other.Resource()) {}
+
+  /**
+   * Allocate storage for a number of objects.
+   *
+   * @param[in] count
+   *    Number of objects of type T to allocate storage for.
+   *
+   * @retval
+   *    Pointer to uninitialized storage.
+   */
+  T *allocate(size_t count) {
+    return static_cast<T *>(
+        resource_->Allocate(count * sizeof(T), alignof(T)));
+  }
+
+  /**
+   * Release storage previously returned by allocate.
+   *
+   * @param[in] storage
+   *    Pointer to the storage to release.
+   *
+   * @param[in] count
+   *    Number of objects the storage was allocated for.
+   */
+  void deallocate(T *storage, size_t count) {
+    resource_->Deallocate(storage, count * sizeof(T), alignof(T));
+  }
+
+  /// Get the resource the allocator draws from.
+  MemoryResource *Resource() const { return resource_; }
+
+private:
+  /// Resource the allocator draws from.
+  MemoryResource *resource_;
+};
+
+template <typename T, typename U>
+bool operator==(const PolyAllocator<T> &a, const PolyAllocator<U> &b) {
+  return a.Resource() == b.Resource();
+}
+
+template <typename T, typename U>
+bool operator!=(const PolyAllocator<T> &a, const PolyAllocator<U> &b) {
+  return a.Resource() != b.Resource();
+}
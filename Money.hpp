@@ -0,0 +1,97 @@
+/**
+ * @file Money.hpp
+ *
+ * Header file describing the Money type used internally for cash balances,
+ * prices and costs.
+ *
+ * By default Money is a double. Building with BROKER_FIXED_POINT defined makes
+ * it an int64_t count of ticks instead, so that all internal arithmetic is
+ * integer-only and results are bit-reproducible across machines. Amounts
+ * passed through the public interface are still doubles, and are rounded to
+ * the nearest tick on the way in.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#ifdef BROKER_FIXED_POINT
+
+/// An amount of money, as a count of ticks.
+typedef int64_t Money;
+
+/// Number of ticks per unit of currency, i.e. one tick is 1e-4 dollars.
+const int64_t MoneyTicksPerUnit = 10000;
+
+/// Convert an amount of currency into Money, rounding to the nearest tick.
+inline Money ToMoney(double amount) {
+  return (Money)std::llround(amount * MoneyTicksPerUnit);
+}
+
+/// Convert Money into an amount of currency.
+inline double FromMoney(Money amount) {
+  return (double)amount / MoneyTicksPerUnit;
+}
+
+/// Get the average price per share of a total cost, in units of currency.
+inline double AveragePrice(Money totalCost, uint64_t quantity) {
+  return (double)totalCost / ((double)quantity * MoneyTicksPerUnit);
+}
+
+/**
+ * Get the share of a non-negative total cost borne by part of a quantity,
+ * rounded down to a tick, without overflowing on large totals.
+ */
+inline Money ProportionalCost(Money totalCost, uint32_t part, uint32_t whole) {
+  Money perShare = totalCost / whole;
+  uint64_t remainder = (uint64_t)(totalCost % whole);
+  return perShare * part + (Money)(remainder * part / whole);
+}
+
+#else
+
+/// An amount of money, in units of currency.
+typedef double Money;
+
+/// Convert an amount of currency into Money.
+inline Money ToMoney(double amount) { return amount; }
+
+/// Convert Money into an amount of currency.
+inline double FromMoney(Money amount) { return amount; }
+
+/// Get the average price per share of a total cost, in units of currency.
+inline double AveragePrice(Money totalCost, uint64_t quantity) {
+  return totalCost / (double)quantity;
+}
+
+/// Get the share of a total cost borne by part of a quantity.
+inline Money ProportionalCost(Money totalCost, uint32_t part, uint32_t whole) {
+  return totalCost * part / whole;
+}
+
+#endif
+
+/**
+ * Get the number of whole shares of a security that can be bought without
+ * exceeding a cash balance.
+ *
+ * @param[in] cash
+ *    The cash available to spend.
+ *
+ * @param[in] price
+ *    The price per share.
+ *
+ * @param[in] quantity
+ *    The number of shares requested.
+ *
+ * @retval
+ *    The number of shares requested, or as many as can be afforded if fewer.
+ */
+inline uint32_t AffordableQuantity(Money cash, Money price, uint32_t quantity) {
+  if (price <= 0) {
+    return quantity;
+  }
+  Money affordable = cash / price;
+  return affordable < quantity ? (uint32_t)affordable : quantity;
+}
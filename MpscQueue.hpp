@@ -0,0 +1,156 @@
+/**
+ * @file MpscQueue.hpp
+ *
+ * Header file describing an MpscQueue, a bounded lock-free queue with many
+ * producers and a single consumer.
+ */
+
+#pragma once
+
+#include "AlignedAllocator.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @class MpscQueue
+ *
+ * Bounded lock-free queue into which any number of threads may push, and
+ * from which a single thread pops.
+ *
+ * The queue is a ring of cells, each with its own sequence number recording
+ * whether it is ready to be written or read on the current lap of the ring.
+ * A producer claims a cell by advancing the shared tail with a
+ * compare-and-swap, writes the value, and then publishes it by bumping the
+ * cell's sequence; the consumer owns the head outright. Producers therefore
+ * only contend on the tail, and never wait for one another to finish
+ * writing.
+ *
+ * Values must be default-constructible and move-assignable.
+ */
+template <typename T> class MpscQueue {
+public:
+  /**
+   * Constructor for the MpscQueue.
+   *
+   * @param[in] capacity
+   *    Maximum number of values the queue can hold, which must be a power of
+   *    two.
+   */
+  MpscQueue(size_t capacity) : cells_(capacity), mask_(capacity - 1) {
+    assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+    for (size_t i = 0; i < capacity; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    head_.position = 0;
+    tail_.store(0, std::memory_order_relaxed);
+  }
+
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  /**
+   * Push a value onto the queue, from any thread.
+   *
+   * @param[in] value
+   *    The value to push, which is moved from only if there is room.
+   *
+   * @retval
+   *    True if the value was pushed, false if the queue is full.
+   */
+  bool TryPush(T &value) {
+    size_t position = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[position & mask_];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      intptr_t lap = (intptr_t)sequence - (intptr_t)position;
+      if (lap == 0) {
+        // The cell is free on this lap, so try to claim it.
+        if (tail_.compare_exchange_weak(position, position + 1,
+                                        std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lap < 0) {
+        // The consumer hasn't emptied the cell since the last lap.
+        return false;
+      } else {
+        // Another producer claimed the cell first.
+        position = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * Pop the oldest value from the queue. Must only be called from the
+   * consumer thread.
+   *
+   * @param[out] value
+   *    Set to the popped value.
+   *
+   * @retval
+   *    True if a value was popped, false if the queue is empty.
+   */
+  bool TryPop(T &value) {
+    Cell &cell = cells_[head_.position & mask_];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (sequence != head_.position + 1) {
+      return false;
+    }
+    value = std::move(cell.value);
+
+    // Hand the cell back to producers for the next lap.
+    size_t position = head_.position++;
+    cell.sequence.store(position + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Check whether the queue is empty. Must only be called from the consumer
+   * thread.
+   *
+   * @retval
+   *    True if there is no value to pop.
+   */
+  bool Empty() const {
+    const Cell &cell = cells_[head_.position & mask_];
+    return cell.sequence.load(std::memory_order_acquire) != head_.position + 1;
+  }
+
+private:
+  /// Struct representing a slot of the ring, on its own cache line.
+  struct alignas(CacheLineSize) Cell {
+    /**
+     * Equal to the position a producer may next write the cell at, or to
+     * that position plus one once the value has been written.
+     */
+    std::atomic<size_t> sequence;
+
+    /// The value held in the cell.
+    T value;
+  };
+
+  /// Ring of cells. Its size is a power of two.
+  std::vector<Cell, AlignedAllocator<Cell>> cells_;
+
+  /// Mask reducing a position to an index into cells_.
+  const size_t mask_;
+
+  /**
+   * Position of the next cell to pop, owned by the consumer. It is padded on
+   * both sides so that it shares no cache line with the fields producers
+   * read or write.
+   */
+  struct {
+    char before[CacheLineSize];
+    size_t position;
+    char after[CacheLineSize - sizeof(size_t)];
+  } head_;
+
+  /// Position of the next cell to push, shared by the producers.
+  std::atomic<size_t> tail_;
+};
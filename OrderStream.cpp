@@ -0,0 +1,143 @@
+/**
+ * @file OrderStream.cpp
+ *
+ * File containing the implementation of the order stream helpers.
+ */
+
+#include "OrderStream.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+std::vector<Order> GenerateOrders(const WorkloadConfig &config) {
+  std::mt19937_64 rng(config.seed);
+  std::uniform_real_distribution<double> unit(0, 1);
+
+  /*
+   * Precompute the cumulative Zipf weights, so that each order's security
+   * can be drawn by binary search on a uniform sample.
+   */
+  std::vector<double> popularity(config.symbols);
+  double total = 0;
+  for (uint32_t k = 0; k < config.symbols; k++) {
+    total += 1 / std::pow(k + 1, config.zipfExponent);
+    popularity[k] = total;
+  }
+
+  std::vector<std::string> names(config.symbols);
+  std::vector<double> prices(config.symbols);
+  for (uint32_t k = 0; k < config.symbols; k++) {
+    names[k] = "SYM" + std::to_string(k);
+    prices[k] = 10 + unit(rng) * 490;
+  }
+
+  std::vector<Order> orders;
+  orders.reserve(config.orders);
+  for (size_t i = 0; i < config.orders; i++) {
+    uint32_t k = (uint32_t)(std::lower_bound(popularity.begin(),
+                                             popularity.end(),
+                                             unit(rng) * total) -
+                            popularity.begin());
+    k = std::min(k, config.symbols - 1);
+
+    // Move the price by up to 1% either way, rounded to the cent.
+    prices[k] *= 1 + (unit(rng) - 0.5) * 0.02;
+    double price = std::max(0.01, std::round(prices[k] * 100) / 100);
+
+    uint32_t quantity;
+    double lotSample = unit(rng);
+    if (config.lotSizeDistribution == LogUniform) {
+      double low = std::log((double)config.minLotSize);
+      double high = std::log((double)config.maxLotSize + 1);
+      quantity = (uint32_t)std::exp(low + lotSample * (high - low));
+    } else {
+      quantity = config.minLotSize +
+                 (uint32_t)(lotSample *
+                            (config.maxLotSize - config.minLotSize + 1));
+    }
+    quantity = std::min(std::max(quantity, config.minLotSize),
+                        config.maxLotSize);
+
+    Order order = {.kind = unit(rng) < config.sellFraction ? Sell : Buy,
+                   .position = {.name = names[k],
+                                .quantity = quantity,
+                                .price = price}};
+    orders.push_back(order);
+  }
+  return orders;
+}
+
+bool ReadOrders(const std::string &path, std::vector<Order> &orders) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string kind;
+    if (!(fields >> kind) || kind[0] == '#') {
+      continue;
+    }
+
+    Order order = {};
+    if (kind == "BUY") {
+      order.kind = Buy;
+    } else if (kind == "SELL") {
+      order.kind = Sell;
+    } else {
+      return false;
+    }
+    /*
+     * Read the quantity into a wider signed type and range check it, since
+     * extracting straight into a uint32_t would wrap a negative quantity
+     * around to a huge one.
+     */
+    std::string name;
+    int64_t quantity;
+    if (!(fields >> name >> quantity >> order.position.price)) {
+      return false;
+    }
+    if (quantity < 0 || quantity > UINT32_MAX) {
+      return false;
+    }
+
+    /*
+     * A price that isn't positive would let a buy add cash rather than
+     * spend it, so it's malformed too, as is anything after the price.
+     */
+    if (!(order.position.price > 0) || !std::isfinite(order.position.price)) {
+      return false;
+    }
+    fields >> std::ws;
+    if (!fields.eof()) {
+      return false;
+    }
+    order.position.quantity = (uint32_t)quantity;
+    order.position.name = name;
+    if (!order.position.name.Valid()) {
+      return false;
+    }
+    orders.push_back(order);
+  }
+  return file.eof();
+}
+
+bool WriteOrders(const std::string &path, const std::vector<Order> &orders) {
+  std::ofstream file(path);
+  if (!file) {
+    return false;
+  }
+
+  file.precision(17);
+  for (const Order &order : orders) {
+    file << (order.kind == Buy ? "BUY " : "SELL ")
+         << order.position.name.ToString() << " " << order.position.quantity
+         << " " << order.position.price << "\n";
+  }
+  return (bool)file.flush();
+}
@@ -0,0 +1,105 @@
+/**
+ * @file OrderStream.hpp
+ *
+ * Header file describing helpers for reading, writing and synthesizing
+ * streams of orders, used to drive a BrokerClient with realistic load.
+ *
+ * Order stream files are plain text with one order per line, of the form
+ * `BUY AAPL 10 101.25` or `SELL AAPL 5 99.5`. Blank lines and lines starting
+ * with `#` are ignored.
+ */
+
+#pragma once
+
+#include "BrokerClient.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Enumeration describing how the quantity of synthetic orders is drawn.
+ */
+enum LotSizeDistribution {
+  /// Every quantity between the minimum and maximum is equally likely.
+  Uniform,
+
+  /// The logarithm of the quantity is uniform, so small lots dominate.
+  LogUniform,
+};
+
+/**
+ * Struct describing the shape of a synthetic order stream.
+ */
+typedef struct {
+  /// Number of orders to generate.
+  size_t orders;
+
+  /// Number of distinct securities traded.
+  uint32_t symbols;
+
+  /**
+   * Exponent of the Zipf distribution of security popularity. The k-th most
+   * popular security is traded with probability proportional to 1 / k^s, so
+   * zero makes every security equally popular.
+   */
+  double zipfExponent;
+
+  /// Probability that any given order is a sell.
+  double sellFraction;
+
+  /// Smallest quantity of an order.
+  uint32_t minLotSize;
+
+  /// Largest quantity of an order.
+  uint32_t maxLotSize;
+
+  /// Distribution of order quantities between the smallest and largest.
+  LotSizeDistribution lotSizeDistribution;
+
+  /// Seed for the random number generator, so streams are reproducible.
+  uint64_t seed;
+} WorkloadConfig;
+
+/**
+ * Generate a synthetic stream of orders. Each security's price follows its
+ * own random walk, starting somewhere between 10 and 500.
+ *
+ * @param[in] config
+ *    The shape of the stream to generate.
+ *
+ * @retval
+ *    The generated orders, in submission order.
+ */
+std::vector<Order> GenerateOrders(const WorkloadConfig &config);
+
+/**
+ * Read a stream of orders from a file.
+ *
+ * @param[in] path
+ *    Path of the file to read.
+ *
+ * @param[out] orders
+ *    Vector to which the orders read are appended.
+ *
+ * @retval
+ *    True if the whole file was read, false if it could not be opened or
+ *    contains a malformed line, including one naming a ticker longer than
+ *    Ticker::MaxLength, with a quantity that is negative or doesn't fit in
+ *    32 bits, with a price that isn't positive and finite, or with anything
+ *    after the price.
+ */
+bool ReadOrders(const std::string &path, std::vector<Order> &orders);
+
+/**
+ * Write a stream of orders to a file, in the format read by ReadOrders.
+ *
+ * @param[in] path
+ *    Path of the file to write.
+ *
+ * @param[in] orders
+ *    The orders to write.
+ *
+ * @retval
+ *    True if the whole stream was written.
+ */
+bool WriteOrders(const std::string &path, const std::vector<Order> &orders);
@@ -0,0 +1,70 @@
+/**
+ * @file PositionSnapshots.cpp
+ *
+ * File containing the implementation of PositionSnapshots.
+ */
+
+#include "PositionSnapshots.hpp"
+#include <cassert>
+
+void PositionSnapshots::Add(Ticker name) {
+  size_t symbol = size_.load(std::memory_order_relaxed);
+  bool grown = records_.Grow(symbol + 1) && dirty_.Grow(symbol / 64 + 1);
+  assert(grown);
+  (void)grown;
+
+  Record &record = records_[symbol];
+  record.sequence.store(0, std::memory_order_relaxed);
+  record.quantity.store(0, std::memory_order_relaxed);
+  record.totalCost.store(0, std::memory_order_relaxed);
+  record.name = name;
+
+  // Only let readers see the record once it's initialized.
+  size_.store(symbol + 1, std::memory_order_release);
+}
+
+void PositionSnapshots::Publish(SymbolId symbol, uint32_t quantity,
+                                Money totalCost) {
+  Record &record = records_[symbol];
+  uint64_t sequence = record.sequence.load(std::memory_order_relaxed);
+
+  /*
+   * Mark the record as being written before touching it. The fence keeps
+   * the field stores from being reordered ahead of the odd sequence number.
+   */
+  record.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  record.quantity.store(quantity, std::memory_order_relaxed);
+  record.totalCost.store(totalCost, std::memory_order_relaxed);
+  record.sequence.store(sequence + 2, std::memory_order_release);
+
+  /*
+   * Mark the position dirty, and only then bump the version, so that a
+   * reader who sees the new version is sure to find the bit set. The bit is
+   * set with a read-modify-write even if it already looks set, so that a
+   * reader taking the word always synchronizes with the latest record. This
+   * thread is the only one that changes the version, so that needs no
+   * read-modify-write.
+   */
+  dirty_[symbol / 64].fetch_or((uint64_t)1 << (symbol % 64),
+                               std::memory_order_release);
+  version_.store(version_.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_release);
+}
+
+PositionSnapshot PositionSnapshots::Read(SymbolId symbol) const {
+  const Record &record = records_[symbol];
+  PositionSnapshot snapshot;
+  for (;;) {
+    uint64_t before = record.sequence.load(std::memory_order_acquire);
+    snapshot.quantity = record.quantity.load(std::memory_order_relaxed);
+    snapshot.totalCost = record.totalCost.load(std::memory_order_relaxed);
+
+    // Keep the field loads from being reordered after the second check.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = record.sequence.load(std::memory_order_relaxed);
+    if (before == after && (before & 1) == 0) {
+      return snapshot;
+    }
+  }
+}
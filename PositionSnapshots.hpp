@@ -0,0 +1,188 @@
+/**
+ * @file PositionSnapshots.hpp
+ *
+ * Header file describing PositionSnapshots, through which a BrokerClient
+ * publishes its positions and cash balance to reader threads.
+ */
+
+#pragma once
+
+#include "AlignedAllocator.hpp"
+#include "ChunkedArray.hpp"
+#include "Money.hpp"
+#include "SymbolTable.hpp"
+#include "Ticker.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Struct representing a consistent snapshot of a single position.
+ */
+typedef struct {
+  /// Quantity of shares held.
+  uint32_t quantity;
+
+  /// Total purchase cost of the shares held.
+  Money totalCost;
+} PositionSnapshot;
+
+/**
+ * @class PositionSnapshots
+ *
+ * Copies of a client's positions and cash balance, written by the thread
+ * processing orders and readable from any other thread without locks.
+ *
+ * Each position is published under a seqlock: the writer makes the record's
+ * sequence number odd, updates the record, and makes it even again, and a
+ * reader retries if the number was odd or changed while it was reading. The
+ * writer never waits for readers, and a reader only retries if it overlaps
+ * an update of the very record it is reading. Records live in a
+ * ChunkedArray, so they never move as securities are added.
+ *
+ * Each publication also sets the security's bit in a dirty bitset and bumps
+ * a version number, so that a reader maintaining its own copy of the
+ * positions can tell whether anything has changed, and if so which
+ * securities to read again.
+ */
+class PositionSnapshots {
+public:
+  PositionSnapshots() : size_(0), version_(0), cashBalance_(0) {}
+  PositionSnapshots(const PositionSnapshots &) = delete;
+  PositionSnapshots &operator=(const PositionSnapshots &) = delete;
+
+  /**
+   * Add an empty position for the next SymbolId, from the writer thread.
+   *
+   * @param[in] name
+   *    Ticker name of the security.
+   */
+  void Add(Ticker name);
+
+  /**
+   * Publish a position, from the writer thread.
+   *
+   * @param[in] symbol
+   *    Id of the security, which must already have been added.
+   *
+   * @param[in] quantity
+   *    Quantity of shares held.
+   *
+   * @param[in] totalCost
+   *    Total purchase cost of the shares held.
+   */
+  void Publish(SymbolId symbol, uint32_t quantity, Money totalCost);
+
+  /**
+   * Publish the cash balance, from the writer thread.
+   *
+   * @param[in] cashBalance
+   *    The client's cash balance.
+   */
+  void PublishCash(Money cashBalance) {
+    cashBalance_.store(cashBalance, std::memory_order_release);
+  }
+
+  /**
+   * Get the number of positions added, from any thread. Every id below this
+   * may be read.
+   *
+   * @retval
+   *    The number of positions.
+   */
+  size_t Size() const { return size_.load(std::memory_order_acquire); }
+
+  /**
+   * Get the ticker name of a position, from any thread.
+   *
+   * @param[in] symbol
+   *    Id of the security, which must be less than Size().
+   *
+   * @retval
+   *    The ticker name of the security.
+   */
+  Ticker Name(SymbolId symbol) const { return records_[symbol].name; }
+
+  /**
+   * Take a consistent snapshot of a position, from any thread.
+   *
+   * @param[in] symbol
+   *    Id of the security, which must be less than Size().
+   *
+   * @retval
+   *    The position as of its most recent publication.
+   */
+  PositionSnapshot Read(SymbolId symbol) const;
+
+  /**
+   * Get the number of publications so far, from any thread. Once a caller
+   * has seen a version, every publication up to it has set its dirty bit.
+   *
+   * @retval
+   *    The number of publications.
+   */
+  uint64_t Version() const { return version_.load(std::memory_order_acquire); }
+
+  /**
+   * Take and clear some bits of a word of the dirty bitset, leaving the
+   * rest set. Word i covers ids 64 * i to 64 * i + 63. Should only be called
+   * from one thread at a time.
+   *
+   * @param[in] word
+   *    Index of the word, which must cover an id less than Size().
+   *
+   * @param[in] mask
+   *    Bits to take, which should only cover ids less than a Size() the
+   *    caller has read, so that positions added since are left for later.
+   *
+   * @retval
+   *    The masked bits, set for each position published since its bit was
+   *    last taken.
+   */
+  uint64_t TakeDirty(size_t word, uint64_t mask) {
+    return dirty_[word].fetch_and(~mask, std::memory_order_acquire) & mask;
+  }
+
+  /**
+   * Get the most recently published cash balance, from any thread.
+   *
+   * @retval
+   *    The client's cash balance.
+   */
+  Money Cash() const { return cashBalance_.load(std::memory_order_acquire); }
+
+private:
+  /**
+   * Struct holding a published position. The fields are atomics only so that
+   * racing reads are well-defined; their consistency comes from the
+   * sequence number.
+   */
+  struct alignas(CacheLineSize) Record {
+    /// Seqlock sequence number, odd while the record is being written.
+    std::atomic<uint64_t> sequence;
+
+    /// Quantity of shares held.
+    std::atomic<uint32_t> quantity;
+
+    /// Total purchase cost of the shares held.
+    std::atomic<Money> totalCost;
+
+    /// Ticker name of the security, set before the record is added.
+    Ticker name;
+  };
+
+  /// Published positions, indexed by SymbolId.
+  ChunkedArray<Record> records_;
+
+  /// Number of positions added.
+  std::atomic<size_t> size_;
+
+  /// One bit per position, set when it is published and cleared when taken.
+  ChunkedArray<std::atomic<uint64_t>> dirty_;
+
+  /// Number of publications, only ever changed by the writer.
+  std::atomic<uint64_t> version_;
+
+  /// Published cash balance.
+  std::atomic<Money> cashBalance_;
+};
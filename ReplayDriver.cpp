@@ -0,0 +1,175 @@
+/**
+ * @file ReplayDriver.cpp
+ *
+ * Standalone driver that replays an order stream through a BrokerClient,
+ * either read from a file or synthesized, and reports throughput, latency
+ * percentiles and the final positions.
+ *
+ * Usage: ./replay [options]
+ *   --file PATH          Replay orders from PATH instead of generating them.
+ *   --write PATH         Also write the generated stream to PATH.
+ *   --orders N           Number of orders to generate (default 1000000).
+ *   --symbols N          Number of distinct securities (default 100).
+ *   --zipf S             Zipf exponent of security popularity (default 1).
+ *   --sell-fraction F    Probability an order is a sell (default 0.3).
+ *   --lot-min N          Smallest order quantity (default 1).
+ *   --lot-max N          Largest order quantity (default 100).
+ *   --lot-dist D         Quantity distribution, uniform or loguniform.
+ *   --seed N             Random seed (default 1).
+ *   --cash C             Starting cash balance (default 10000000).
+ *   --by-id              Intern symbols up front and submit orders by id.
+ *   --positions N        Number of final positions to print (default 20).
+ */
+
+#include "BrokerClient.hpp"
+#include "LatencyStats.hpp"
+#include "OrderStream.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// Print usage information and exit.
+static void Usage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " [--file PATH] [--write PATH] [--orders N] [--symbols N]"
+               " [--zipf S] [--sell-fraction F] [--lot-min N] [--lot-max N]"
+               " [--lot-dist uniform|loguniform] [--seed N] [--cash C]"
+               " [--by-id] [--positions N]"
+            << std::endl;
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  WorkloadConfig config = {.orders = 1000000,
+                           .symbols = 100,
+                           .zipfExponent = 1,
+                           .sellFraction = 0.3,
+                           .minLotSize = 1,
+                           .maxLotSize = 100,
+                           .lotSizeDistribution = Uniform,
+                           .seed = 1};
+  std::string inputPath;
+  std::string outputPath;
+  double cash = 10000000;
+  bool byId = false;
+  size_t positionsShown = 20;
+
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (flag == "--by-id") {
+      byId = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      Usage(argv[0]);
+    }
+    const char *value = argv[++i];
+    if (flag == "--file") {
+      inputPath = value;
+    } else if (flag == "--write") {
+      outputPath = value;
+    } else if (flag == "--orders") {
+      config.orders = strtoull(value, nullptr, 10);
+    } else if (flag == "--symbols") {
+      config.symbols = (uint32_t)strtoul(value, nullptr, 10);
+    } else if (flag == "--zipf") {
+      config.zipfExponent = atof(value);
+    } else if (flag == "--sell-fraction") {
+      config.sellFraction = atof(value);
+    } else if (flag == "--lot-min") {
+      config.minLotSize = (uint32_t)strtoul(value, nullptr, 10);
+    } else if (flag == "--lot-max") {
+      config.maxLotSize = (uint32_t)strtoul(value, nullptr, 10);
+    } else if (flag == "--lot-dist") {
+      if (strcmp(value, "uniform") == 0) {
+        config.lotSizeDistribution = Uniform;
+      } else if (strcmp(value, "loguniform") == 0) {
+        config.lotSizeDistribution = LogUniform;
+      } else {
+        Usage(argv[0]);
+      }
+    } else if (flag == "--seed") {
+      config.seed = strtoull(value, nullptr, 10);
+    } else if (flag == "--cash") {
+      cash = atof(value);
+    } else if (flag == "--positions") {
+      positionsShown = strtoull(value, nullptr, 10);
+    } else {
+      Usage(argv[0]);
+    }
+  }
+  if (config.symbols == 0 || config.minLotSize == 0 ||
+      config.minLotSize > config.maxLotSize) {
+    Usage(argv[0]);
+  }
+
+  // Load or synthesize the stream.
+  std::vector<Order> orders;
+  if (!inputPath.empty()) {
+    if (!ReadOrders(inputPath, orders)) {
+      std::cerr << "Failed to read orders from " << inputPath << std::endl;
+      return 1;
+    }
+  } else {
+    orders = GenerateOrders(config);
+    if (!outputPath.empty() && !WriteOrders(outputPath, orders)) {
+      std::cerr << "Failed to write orders to " << outputPath << std::endl;
+      return 1;
+    }
+  }
+
+  BrokerClient client = BrokerClient(cash);
+  std::vector<SymbolId> ids;
+  if (byId) {
+    for (const Order &order : orders) {
+      ids.push_back(client.InternSymbol(order.position.name));
+    }
+  }
+
+  // Replay the stream, timing every order.
+  std::vector<uint64_t> samples(orders.size());
+  uint64_t filledOrders = 0;
+  uint64_t filledShares = 0;
+  uint64_t start = NowNs();
+  for (size_t i = 0; i < orders.size(); i++) {
+    const Order &order = orders[i];
+    uint64_t orderStart = NowNs();
+    uint32_t filled =
+        byId ? client.SubmitOrder(order.kind, ids[i], order.position.quantity,
+                                  order.position.price)
+             : client.SubmitOrder(order);
+    samples[i] = NowNs() - orderStart;
+    filledOrders += filled > 0;
+    filledShares += filled;
+  }
+  uint64_t totalNs = NowNs() - start;
+  LatencySummary summary = SummarizeLatency(orders.size(), totalNs, samples);
+
+  printf("Orders:      %llu (%llu filled, %llu shares)\n",
+         (unsigned long long)orders.size(), (unsigned long long)filledOrders,
+         (unsigned long long)filledShares);
+  printf("Throughput:  %.0f orders/s (%.1f ns/order)\n", summary.opsPerSec,
+         summary.nsPerOp);
+  printf("Latency:     p50 %llu ns, p99 %llu ns, p999 %llu ns, max %llu ns\n",
+         (unsigned long long)summary.p50Ns, (unsigned long long)summary.p99Ns,
+         (unsigned long long)summary.p999Ns,
+         (unsigned long long)summary.maxNs);
+  printf("Cash:        %.2f\n", client.GetCashBalance());
+
+  // Show the largest positions by cost.
+  std::vector<SecurityPosition> positions = client.GetPositions();
+  std::sort(positions.begin(), positions.end(),
+            [](const SecurityPosition &a, const SecurityPosition &b) {
+              return a.quantity * a.price > b.quantity * b.price;
+            });
+  printf("Positions:   %zu held\n", positions.size());
+  for (size_t i = 0; i < positions.size() && i < positionsShown; i++) {
+    printf("  %-10s %10u @ %.4f\n", positions[i].name.ToString().c_str(),
+           positions[i].quantity, positions[i].price);
+  }
+  return 0;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file SymbolTable.cpp
+ *
+ * File containing the implementation of the SymbolTable.
+ */
+
+#include "SymbolTable.hpp"
+
+SymbolId SymbolTable::Intern(Ticker name) {
+  auto it = ids_.find(name);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+
+  SymbolId id = (SymbolId)names_.size();
+  ids_.insert(std::make_pair(name, id));
+  names_.push_back(name);
+  return id;
+}
+
+SymbolId SymbolTable::Find(Ticker name) const {
+  auto it = ids_.find(name);
+  return it == ids_.end() ? InvalidSymbolId : it->second;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file SymbolTable.hpp
+ *
+ * Header file describing a SymbolTable, which interns ticker names into dense
+ * integer identifiers so that internal state can be keyed by integer rather
+ * than by string.
+ */
+
+#pragma once
+
+#include "MemoryResource.hpp"
+#include "Ticker.hpp"
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Dense integer identifier for a security. Identifiers are assigned in
+ * increasing order starting from zero, in the order symbols are interned.
+ */
+typedef uint32_t SymbolId;
+
+/// Sentinel identifier returned when a symbol has not been interned.
+const SymbolId InvalidSymbolId = UINT32_MAX;
+
+/**
+ * @class SymbolTable
+ *
+ * Maps ticker names to dense SymbolIds and back. Each distinct name is hashed
+ * once, when it is first interned; afterwards callers can refer to the
+ * security by id alone.
+ */
+class SymbolTable {
+public:
+  /**
+   * Constructor for the SymbolTable.
+   *
+   * @param[in] resource
+   *    Resource from which the table is allocated, or null for the default.
+   */
+  explicit SymbolTable(MemoryResource *resource = nullptr)
+      : ids_(0, std::hash<Ticker>(), std::equal_to<Ticker>(),
+             PolyAllocator<std::pair<const Ticker, SymbolId>>(resource)),
+        names_(PolyAllocator<Ticker>(resource)) {}
+
+  /**
+   * Get the id for a ticker name, assigning a new id if the name has not
+   * been seen before.
+   *
+   * @param[in] name
+   *    Ticker name of the security.
+   *
+   * @retval
+   *    The id for the given name.
+   */
+  SymbolId Intern(Ticker name);
+
+  /**
+   * Get the id for a ticker name without interning it.
+   *
+   * @param[in] name
+   *    Ticker name of the security.
+   *
+   * @retval
+   *    The id for the given name, or InvalidSymbolId if it is unknown.
+   */
+  SymbolId Find(Ticker name) const;
+
+  /**
+   * Get the ticker name for an id previously returned by Intern.
+   *
+   * @param[in] id
+   *    Id of the security.
+   *
+   * @retval
+   *    The ticker name of the security.
+   */
+  Ticker Name(SymbolId id) const { return names_[id]; }
+
+  /**
+   * Get the number of interned symbols. Every id is strictly less than this.
+   *
+   * @retval
+   *    The number of interned symbols.
+   */
+  size_t Size() const { return names_.size(); }
+
+private:
+  /// Map of ticker name into its assigned id.
+  std::unordered_map<Ticker, SymbolId, std::hash<Ticker>,
+                     std::equal_to<Ticker>,
+                     PolyAllocator<std::pair<const Ticker, SymbolId>>>
+      ids_;
+
+  /// Ticker names, indexed by id.
+  std::vector<Ticker, PolyAllocator<Ticker>> names_;
+};
@@ -0,0 +1,109 @@
+/**
+ * @file Ticker.hpp
+ *
+ * Header file describing a Ticker, a fixed-width ticker name stored inline
+ * in two 64-bit words.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+
+/**
+ * @class Ticker
+ *
+ * Ticker name of a security, of up to MaxLength characters, stored inline and
+ * padded with zeros. A Ticker is trivially copyable, never allocates, and
+ * compares and hashes as two integers, so that orders and positions holding
+ * one are plain data that can be copied with memcpy.
+ *
+ * Names longer than MaxLength cannot be represented. Constructing a Ticker
+ * from one gives an invalid ticker, which compares equal only to other
+ * invalid tickers, and which the clients refuse to trade. Names should not
+ * contain null characters, which would end them early.
+ */
+class Ticker {
+public:
+  /// Maximum length of a ticker name.
+  static const size_t MaxLength = 16;
+
+  /// Constructor for an empty ticker name.
+  Ticker() : words_{0, 0} {}
+
+  /// Constructor from a null-terminated name.
+  Ticker(const char *name) : Ticker(name, strlen(name)) {}
+
+  /// Constructor from a name.
+  Ticker(const std::string &name) : Ticker(name.data(), name.size()) {}
+
+  /**
+   * Constructor from a name that need not be null-terminated.
+   *
+   * @param[in] name
+   *    Pointer to the characters of the name.
+   *
+   * @param[in] length
+   *    Number of characters in the name.
+   */
+  Ticker(const char *name, size_t length) : words_{0, 0} {
+    if (length > MaxLength) {
+      words_[0] = words_[1] = UINT64_MAX;
+    } else {
+      memcpy(words_, name, length);
+    }
+  }
+
+  /**
+   * Check whether the name fitted into the ticker.
+   *
+   * @retval
+   *    False if the ticker was made from a name longer than MaxLength.
+   */
+  bool Valid() const { return (words_[0] & words_[1]) != UINT64_MAX; }
+
+  /// Get the characters of the name, which are null-terminated if shorter
+  /// than MaxLength.
+  const char *Data() const { return reinterpret_cast<const char *>(words_); }
+
+  /// Get the length of the name.
+  size_t Size() const { return strnlen(Data(), MaxLength); }
+
+  /// Get a character of the name.
+  char operator[](size_t index) const { return Data()[index]; }
+
+  /// Get the name as a string.
+  std::string ToString() const { return std::string(Data(), Size()); }
+
+  /// Get a hash of the name, mixing both words.
+  size_t Hash() const {
+    uint64_t hash = words_[0] * 0x9E3779B97F4A7C15ULL ^ words_[1];
+    hash = (hash ^ (hash >> 29)) * 0xBF58476D1CE4E5B9ULL;
+    return (size_t)(hash ^ (hash >> 32));
+  }
+
+  bool operator==(const Ticker &other) const {
+    return words_[0] == other.words_[0] && words_[1] == other.words_[1];
+  }
+
+  bool operator!=(const Ticker &other) const { return !(*this == other); }
+
+  /// Order tickers as their names would be ordered.
+  bool operator<(const Ticker &other) const {
+    return memcmp(words_, other.words_, sizeof(words_)) < 0;
+  }
+
+private:
+  /// Characters of the name, padded with zeros.
+  uint64_t words_[2];
+};
+
+namespace std {
+/// Hash of a Ticker, for use as a key in unordered containers.
+template <> struct hash<Ticker> {
+  size_t operator()(const Ticker &ticker) const { return ticker.Hash(); }
+};
+} // namespace std
@@ -0,0 +1,128 @@
+/**
+ * @file TransactionJournal.cpp
+ *
+ * File containing the implementation of the TransactionJournal.
+ */
+
+#include "TransactionJournal.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Magic bytes identifying a journal file, including its format version.
+static const char JournalMagic[8] = {'B', 'R', 'K', 'J', 'R', 'N', 'L', '1'};
+
+/// Number of records a newly created journal file has room for.
+static const uint64_t InitialJournalCapacity = 1 << 16;
+
+TransactionJournal::~TransactionJournal() {
+  Unmap();
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool TransactionJournal::Open(const std::string &path, double initialCash) {
+  assert(fd_ < 0);
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd_, &info) != 0) {
+    return false;
+  }
+
+  // A new, empty file gets a fresh header.
+  if (info.st_size == 0) {
+    if (!Map(InitialJournalCapacity)) {
+      return false;
+    }
+    memcpy(header_->magic, JournalMagic, sizeof(JournalMagic));
+    header_->recordSize = sizeof(JournalRecord);
+    header_->reserved = 0;
+    header_->initialCash = initialCash;
+    header_->count = 0;
+    return true;
+  }
+
+  // Otherwise map the existing file as it is, and check it's a journal.
+  if ((size_t)info.st_size < sizeof(JournalHeader)) {
+    return false;
+  }
+  if (!Map((info.st_size - sizeof(JournalHeader)) / sizeof(JournalRecord))) {
+    return false;
+  }
+  return memcmp(header_->magic, JournalMagic, sizeof(JournalMagic)) == 0 &&
+         header_->recordSize == sizeof(JournalRecord) &&
+         header_->count <= capacity_;
+}
+
+bool TransactionJournal::Reserve(uint64_t count) {
+  uint64_t required = header_->count + count;
+  if (required <= capacity_) {
+    return true;
+  }
+  return Map(std::max(required, 2 * capacity_));
+}
+
+void TransactionJournal::Append(uint32_t kind, Ticker name, uint32_t quantity,
+                                double price) {
+  assert(header_->count < capacity_);
+  assert(name.Valid());
+
+  JournalRecord &record = records_[header_->count];
+  record.kind = kind;
+  record.quantity = quantity;
+  record.price = price;
+  memcpy(record.name, name.Data(), JournalNameLength);
+
+  // Only publish the record once it has been completely written.
+  std::atomic_signal_fence(std::memory_order_release);
+  header_->count++;
+}
+
+bool TransactionJournal::Sync() {
+  size_t length = sizeof(JournalHeader) + capacity_ * sizeof(JournalRecord);
+  return msync(header_, length, MS_SYNC) == 0;
+}
+
+bool TransactionJournal::Map(uint64_t capacity) {
+  size_t length = sizeof(JournalHeader) + capacity * sizeof(JournalRecord);
+
+  struct stat info;
+  if (fstat(fd_, &info) != 0) {
+    return false;
+  }
+  if ((size_t)info.st_size < length && ftruncate(fd_, length) != 0) {
+    return false;
+  }
+
+  // Only replace the existing mapping once the new one has succeeded.
+  void *mapping =
+      mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  Unmap();
+  header_ = static_cast<JournalHeader *>(mapping);
+  records_ = reinterpret_cast<JournalRecord *>(header_ + 1);
+  capacity_ = capacity;
+  return true;
+}
+
+void TransactionJournal::Unmap() {
+  if (header_ != nullptr) {
+    munmap(header_,
+           sizeof(JournalHeader) + capacity_ * sizeof(JournalRecord));
+    header_ = nullptr;
+    records_ = nullptr;
+    capacity_ = 0;
+  }
+}
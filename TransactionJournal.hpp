@@ -0,0 +1,180 @@
+/**
+ * @file TransactionJournal.hpp
+ *
+ * Header file describing a TransactionJournal, an append-only memory-mapped
+ * file of fixed-size records, one per fill, from which a BrokerClient can be
+ * rebuilt after a restart.
+ */
+
+#pragma once
+
+#include "ArrayView.hpp"
+#include "Ticker.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// Maximum length of a ticker name that can be recorded in the journal.
+const size_t JournalNameLength = Ticker::MaxLength;
+
+static_assert(sizeof(Ticker) == JournalNameLength,
+              "a ticker must be stored exactly as a journal name");
+
+/**
+ * Struct representing a single fill in the journal.
+ */
+typedef struct {
+  /// Type of the fill, as an OrderKind.
+  uint32_t kind;
+
+  /// Quantity of shares bought or sold.
+  uint32_t quantity;
+
+  /// Price per share at which the shares were bought or sold.
+  double price;
+
+  /**
+   * Ticker name of the security, padded with zeros. It is only
+   * null-terminated if shorter than JournalNameLength.
+   */
+  char name[JournalNameLength];
+} JournalRecord;
+
+/**
+ * Struct describing the header at the start of a journal file.
+ */
+typedef struct {
+  /// Identifies the file as a journal, and the version of its format.
+  char magic[8];
+
+  /// Size of each record, to detect records written by a different layout.
+  uint32_t recordSize;
+
+  /// Padding, always zero.
+  uint32_t reserved;
+
+  /// Cash balance of the client before the first fill.
+  double initialCash;
+
+  /// Number of records in the journal.
+  uint64_t count;
+} JournalHeader;
+
+/**
+ * @class TransactionJournal
+ *
+ * Append-only journal of fills, stored as a header followed by an array of
+ * fixed-size records in a memory-mapped file. Appending writes the record
+ * straight into the mapping and then bumps the record count in the header,
+ * so a record is only ever visible once it is complete. The file is grown
+ * (and remapped) geometrically as it fills up.
+ */
+class TransactionJournal {
+public:
+  TransactionJournal() {}
+  ~TransactionJournal();
+  TransactionJournal(const TransactionJournal &) = delete;
+  TransactionJournal &operator=(const TransactionJournal &) = delete;
+
+  /**
+   * Open a journal file, creating it if it doesn't exist.
+   *
+   * @param[in] path
+   *    Path of the journal file.
+   *
+   * @param[in] initialCash
+   *    Cash balance to record in the header if the journal is created.
+   *    Ignored if the journal already exists.
+   *
+   * @retval
+   *    True if the journal was opened, false if the file could not be
+   *    created or mapped, or is not a valid journal.
+   */
+  bool Open(const std::string &path, double initialCash);
+
+  /**
+   * Get the cash balance recorded when the journal was created.
+   *
+   * @retval
+   *    The cash balance before the first fill.
+   */
+  double InitialCash() const { return header_->initialCash; }
+
+  /**
+   * Get a view of every record in the journal, in order. The view is
+   * invalidated by the next append.
+   *
+   * @retval
+   *    A view of the journal's records.
+   */
+  ArrayView<JournalRecord> Records() const {
+    return ArrayView<JournalRecord>(records_, header_->count);
+  }
+
+  /**
+   * Ensure the journal can take at least a number of further records
+   * without failing, growing the file if necessary.
+   *
+   * @param[in] count
+   *    The number of records to make room for.
+   *
+   * @retval
+   *    True if there is room, false if the file could not be grown.
+   */
+  bool Reserve(uint64_t count);
+
+  /**
+   * Append a record to the journal.
+   *
+   * @note
+   *    Room for the record must already have been made with Reserve.
+   *
+   * @param[in] kind
+   *    Type of the fill, as an OrderKind.
+   *
+   * @param[in] name
+   *    Ticker name of the security, which must be valid.
+   *
+   * @param[in] quantity
+   *    Quantity of shares bought or sold.
+   *
+   * @param[in] price
+   *    Price per share at which the shares were bought or sold.
+   */
+  void Append(uint32_t kind, Ticker name, uint32_t quantity, double price);
+
+  /**
+   * Flush the journal to disk, blocking until it has been written.
+   *
+   * @retval
+   *    True if the journal was flushed.
+   */
+  bool Sync();
+
+private:
+  /// File descriptor of the journal file, or -1 if not open.
+  int fd_ = -1;
+
+  /// Start of the mapping, which is the header.
+  JournalHeader *header_ = nullptr;
+
+  /// Records in the mapping, following the header.
+  JournalRecord *records_ = nullptr;
+
+  /// Number of records the current mapping has room for.
+  uint64_t capacity_ = 0;
+
+  /**
+   * Resize the file to hold a number of records, and map all of it.
+   *
+   * @param[in] capacity
+   *    The number of records the file should have room for.
+   *
+   * @retval
+   *    True if the file was resized and mapped.
+   */
+  bool Map(uint64_t capacity);
+
+  /// Unmap the file, if it is mapped.
+  void Unmap();
+};